@@ -24,6 +24,7 @@ complete -f -c paradox -n '__fish_prog_needs_command' -a pack -d 'Pack-Archiv Ut
 complete -f -c paradox -n '__fish_prog_needs_command' -a fdb -d 'FDB Utility'
 complete -f -c paradox -n '__fish_prog_needs_command' -a data -d 'Data Utilities'
 complete -f -c paradox -n '__fish_prog_needs_command' -a net -d 'Network Helpers'
+complete -f -c paradox -n '__fish_prog_needs_command' -a bench -d 'Micro-Benchmarks'
 complete -f -c paradox -n '__fish_prog_needs_command' -a test -d 'Test Methods'
 complete -f -c paradox -n '__fish_prog_needs_command' -a help -d 'Command Overview'
 
@@ -0,0 +1,827 @@
+#include "bench_cli.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <random>
+#include <cstring>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <assembly/manifest.hpp>
+#include <assembly/cli.hpp>
+
+#include "codec.hpp"
+#include "crc.hpp"
+#include "md5.h"
+#include "md5_multi.hpp"
+#include "pack.hpp"
+#include "parallel.hpp"
+#include "sd0_codec.hpp"
+#include "sd0_stream.hpp"
+#include "static_stage.hpp"
+#include "pipeline.hpp"
+#include "transform.hpp"
+#include "zlib_stream.hpp"
+
+using namespace assembly::manifest;
+
+cli::opt_t bench_options[] =
+{
+	{ "crc",	&bench_crc,		"Compare the filename CRC implementations"	},
+	{ "sd0",	&bench_sd0,		"Compare serial and block-parallel sd0 decoding"	},
+	{ "seek",	&bench_seek,	"Compare reading slices of sd0 files with and without seeking"	},
+	{ "stream",	&bench_stream,	"Measure the stream buffers at several buffer sizes"	},
+	{ "codec",	&bench_codec,	"Compare the inflate/deflate backends on sd0 blocks"	},
+	{ "md5",	&bench_md5,		"Check and compare the multi-buffer MD5 engines"	},
+	{ "chain",	&bench_chain,	"Compare a static and a dynamic sd0 >> md5 chain"	},
+	{ "help",	&help_bench,	"Show this help message"					},
+	{ 0, 0, 0 }
+};
+
+int main_bench(int argc, char** argv)
+{
+	int command = 1;
+
+	if (argc <= command) {
+		std::cout << "Usage: bench <subcommand> ..." << std::endl;
+		return 1;
+	}
+
+	return cli::call("BenchCLI", bench_options, argv[command], argc - command, argv + command);
+}
+
+int help_bench(int, char**)
+{
+	return cli::help("BenchCLI", bench_options, "Micro-benchmarks for the hot paths");
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ *	Prints one result line: time per item and items per second
+ */
+void bench_report(const std::string& name, bench_clock::duration time, uint64_t items)
+{
+	double ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << std::setw(12) << name << ": "
+	          << std::fixed << std::setprecision(2)
+	          << std::setw(8) << (ns / items) << " ns/path, "
+	          << std::setw(8) << (items * 1e3 / ns) << " M paths/s" << std::endl;
+}
+
+/**
+ *	Prints one result line for a data benchmark: throughput in MB/s
+ */
+void bench_report_bytes(const std::string& name, bench_clock::duration time, uint64_t bytes)
+{
+	double s = std::chrono::duration<double>(time).count();
+	std::cout << std::setw(12) << name << ": "
+	          << std::fixed << std::setprecision(2)
+	          << std::setw(8) << (s * 1e3) << " ms, "
+	          << std::setw(8) << (bytes / s / 1e6) << " MB/s" << std::endl;
+}
+
+/**
+ *	Builds an sd0 buffer with standard blocks from data
+ */
+static std::string make_sd0(const std::string& data)
+{
+	std::string out("sd0\x01\xff", 5);
+	std::vector<char> block(compressBound(SD0_BLOCK_SIZE));
+	for (std::size_t pos = 0; pos < data.size(); pos += SD0_BLOCK_SIZE)
+	{
+		uLongf size = block.size();
+		uLong len = std::min<std::size_t>(SD0_BLOCK_SIZE, data.size() - pos);
+		compress2((Bytef*) block.data(), &size, (const Bytef*) data.data() + pos, len, 4);
+
+		uint32_t length = size;
+		out.append((const char*) &length, 4);
+		out.append(block.data(), size);
+	}
+	return out;
+}
+
+int bench_crc(int argc, char** argv)
+{
+	int rounds = 10;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			rounds = std::stoi(optarg);
+			break;
+		}
+	}
+
+	std::vector<manifest_entry> files;
+	for (int i = optind; i < argc; i++)
+	{
+		manifest_file manifest;
+		if (read_from_file(argv[i], manifest) != 0)
+		{
+			std::cerr << "Could not read manifest '" << argv[i] << "'" << std::endl;
+			return 1;
+		}
+		files.insert(files.end(), manifest.files.begin(), manifest.files.end());
+	}
+
+	/* Without a manifest, use paths shaped like the ones in the client */
+	if (files.empty())
+	{
+		for (int i = 0; i < 100000; i++)
+		{
+			std::stringstream path;
+			path << "client/res/textures/auramar/Mesh_" << (i % 997) << "/AM_Tile_" << i << ".dds";
+			manifest_entry entry;
+			entry.path = path.str();
+			files.push_back(entry);
+		}
+	}
+
+	uint64_t items = (uint64_t) files.size() * rounds;
+	std::cout << "Paths: " << files.size() << ", Rounds: " << rounds << std::endl;
+
+	std::vector<uint32_t> reference(files.size());
+	std::vector<uint32_t> single(files.size());
+	std::vector<uint32_t> batch;
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+		for (size_t i = 0; i < files.size(); i++)
+			reference[i] = crc::path_bitwise(files[i].path.c_str());
+	bench_report("bitwise", bench_clock::now() - start, items);
+
+	start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+		for (size_t i = 0; i < files.size(); i++)
+			single[i] = pack::GetCRCForFilename(files[i].path.c_str());
+	bench_report("table", bench_clock::now() - start, items);
+
+	start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+		pack::GetCRCForFilenames(files, batch);
+	bench_report("batch", bench_clock::now() - start, items);
+
+	if (single != reference || batch != reference)
+	{
+		std::cerr << "Mismatch between the CRC implementations!" << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
+
+int bench_sd0(int argc, char** argv)
+{
+	int rounds = 5;
+	unsigned threads = 0;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:j:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			rounds = std::stoi(optarg);
+			break;
+
+			case 'j':
+			threads = std::stoul(optarg);
+			break;
+		}
+	}
+
+	std::vector<std::string> inputs;
+	for (int i = optind; i < argc; i++)
+	{
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Could not read '" << argv[i] << "'" << std::endl;
+			return 1;
+		}
+		std::stringstream data;
+		data << file.rdbuf();
+		inputs.push_back(data.str());
+	}
+
+	/* Without files, use 64 MiB of data that compresses about as well as terrain */
+	if (inputs.empty())
+	{
+		std::mt19937 random(42);
+		std::string data(64 << 20, 0);
+		for (std::size_t i = 0; i < data.size(); i++)
+		{
+			data[i] = (random() & 0x0F) == 0 ? (char) random() : (char) ((i >> 6) & 0x3F);
+		}
+		inputs.push_back(make_sd0(data));
+	}
+
+	if (threads == 0) threads = parallel::default_threads();
+
+	uint64_t compressed = 0;
+	for (const std::string& input : inputs) compressed += input.size();
+	std::cout << "Files: " << inputs.size() << ", Compressed: " << (compressed >> 20) << " MiB, Threads: " << threads << std::endl;
+
+	std::vector<std::vector<char>> serial(inputs.size());
+	std::vector<std::vector<char>> split(inputs.size());
+	uint64_t bytes = 0;
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (std::size_t i = 0; i < inputs.size(); i++)
+		{
+			if (!sd0_decode_parallel(inputs[i].data(), inputs[i].size(), serial[i], 1))
+			{
+				std::cerr << "Could not decode input " << i << std::endl;
+				return 2;
+			}
+			bytes += serial[i].size();
+		}
+	}
+	bench_report_bytes("serial", (bench_clock::now() - start) / rounds, bytes / rounds);
+
+	start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (std::size_t i = 0; i < inputs.size(); i++)
+		{
+			sd0_decode_parallel(inputs[i].data(), inputs[i].size(), split[i], threads);
+		}
+	}
+	bench_report_bytes("parallel", (bench_clock::now() - start) / rounds, bytes / rounds);
+
+	if (split != serial)
+	{
+		std::cerr << "Mismatch between serial and parallel decoding!" << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
+
+int bench_seek(int argc, char** argv)
+{
+	int reads = 1000;
+	int slice = 4096;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			reads = std::stoi(optarg);
+			break;
+
+			case 's':
+			slice = std::stoi(optarg);
+			break;
+		}
+	}
+
+	/* Without a file, use 32 MiB of generated data */
+	std::stringstream generated;
+	std::ifstream file;
+	std::istream* input = &generated;
+	sd0_index index;
+
+	if (argc > optind)
+	{
+		file.open(argv[optind], std::ios::binary);
+		if (!file.is_open() || !index.load(argv[optind]))
+		{
+			std::cerr << "Could not read '" << argv[optind] << "'" << std::endl;
+			return 1;
+		}
+		input = &file;
+	}
+	else
+	{
+		std::mt19937 random(42);
+		std::string data(32 << 20, 0);
+		for (std::size_t i = 0; i < data.size(); i++)
+		{
+			data[i] = (random() & 0x0F) == 0 ? (char) random() : (char) ((i >> 6) & 0x3F);
+		}
+		generated.str(make_sd0(data));
+		index.build(generated);
+	}
+
+	uint64_t total = index.uncompressed_size();
+	if (total < (uint64_t) slice)
+	{
+		std::cerr << "The file is smaller than a slice" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Blocks: " << index.size() << ", Size: " << (total >> 20) << " MiB, Slice: " << slice << " B" << std::endl;
+
+	std::mt19937_64 random(7);
+	std::vector<uint64_t> offsets(reads);
+	for (uint64_t& offset : offsets) offset = random() % (total - slice + 1);
+
+	std::vector<char> expected(slice);
+	std::vector<char> actual(slice);
+
+	/* Inflating from the start is slow, so only a few reads are timed that way */
+	int slow = std::min(reads, 10);
+	std::vector<std::string> reference(slow);
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < slow; i++)
+	{
+		input->clear();
+		input->seekg(0);
+		sd0_istreambuf buf(input);
+		std::istream stream(&buf);
+		stream.ignore(offsets[i]);
+		stream.read(expected.data(), slice);
+		reference[i].assign(expected.data(), slice);
+	}
+	bench_clock::duration time = bench_clock::now() - start;
+	std::cout << std::setw(12) << "from start" << ": " << std::fixed << std::setprecision(2)
+	          << std::setw(8) << std::chrono::duration<double, std::micro>(time).count() / slow << " us/read" << std::endl;
+
+	sd0_seek_istreambuf buf(input, &index);
+	std::istream stream(&buf);
+
+	start = bench_clock::now();
+	for (int i = 0; i < reads; i++)
+	{
+		stream.clear();
+		stream.seekg(offsets[i]);
+		stream.read(actual.data(), slice);
+
+		if (i < slow && reference[i].compare(0, slice, actual.data(), slice) != 0)
+		{
+			std::cerr << "Mismatch at offset " << offsets[i] << "!" << std::endl;
+			return 2;
+		}
+	}
+	time = bench_clock::now() - start;
+	std::cout << std::setw(12) << "seek" << ": " << std::fixed << std::setprecision(2)
+	          << std::setw(8) << std::chrono::duration<double, std::micro>(time).count() / reads << " us/read" << std::endl;
+
+	return 0;
+}
+
+/**
+ *	Reads a whole stream in chunks of the given size, returns the number of bytes
+ */
+static uint64_t drain_stream(std::istream& stream, std::vector<char>& chunk)
+{
+	uint64_t total = 0;
+	while (stream.read(chunk.data(), chunk.size()) || stream.gcount() > 0)
+	{
+		total += stream.gcount();
+	}
+	return total;
+}
+
+int bench_stream(int argc, char** argv)
+{
+	int megabytes = 64;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "m:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm':
+			megabytes = std::stoi(optarg);
+			break;
+		}
+	}
+
+	std::mt19937 random(42);
+	std::string data((std::size_t) megabytes << 20, 0);
+	for (std::size_t i = 0; i < data.size(); i++)
+	{
+		data[i] = (random() & 0x0F) == 0 ? (char) random() : (char) ((i >> 6) & 0x3F);
+	}
+
+	std::string sd0 = make_sd0(data);
+	std::vector<char> zlib(compressBound(data.size()));
+	uLongf zlibSize = zlib.size();
+	compress2((Bytef*) zlib.data(), &zlibSize, (const Bytef*) data.data(), data.size(), 4);
+	zlib.resize(zlibSize);
+
+	std::cout << "Data: " << megabytes << " MiB, sd0: " << (sd0.size() >> 20) << " MiB, zlib: " << (zlib.size() >> 20) << " MiB" << std::endl;
+
+	std::size_t previous = stream_buffer_size();
+	const std::size_t sizes[] = {4096, 65536, 1048576};
+	const char* names[] = {"4K", "64K", "1M"};
+
+	for (int s = 0; s < 3; s++)
+	{
+		std::size_t size = sizes[s];
+		stream_buffer_size() = size;
+		std::vector<char> chunk(size);
+
+		{
+			std::istringstream input(std::string(zlib.data(), zlib.size()));
+			bench_clock::time_point start = bench_clock::now();
+			zlib_istreambuf buf(&input);
+			std::istream stream(&buf);
+			uint64_t bytes = drain_stream(stream, chunk);
+			bench_report_bytes(std::string("zlib in ") + names[s], bench_clock::now() - start, bytes);
+			if (bytes != data.size()) std::cerr << "Short zlib read!" << std::endl;
+		}
+
+		{
+			std::istringstream input(sd0);
+			bench_clock::time_point start = bench_clock::now();
+			sd0_istreambuf buf(&input);
+			std::istream stream(&buf);
+			uint64_t bytes = drain_stream(stream, chunk);
+			bench_report_bytes(std::string("sd0 in ") + names[s], bench_clock::now() - start, bytes);
+			if (bytes != data.size()) std::cerr << "Short sd0 read!" << std::endl;
+		}
+
+		{
+			std::ostringstream output;
+			bench_clock::time_point start = bench_clock::now();
+			{
+				sd0_ostreambuf buf(&output);
+				std::ostream stream(&buf);
+				for (std::size_t pos = 0; pos < data.size(); pos += size)
+				{
+					stream.write(data.data() + pos, std::min(size, data.size() - pos));
+				}
+			}
+			bench_report_bytes(std::string("sd0 out ") + names[s], bench_clock::now() - start, data.size());
+		}
+	}
+
+	stream_buffer_size() = previous;
+	return 0;
+}
+
+int bench_codec(int argc, char** argv)
+{
+	int rounds = 5;
+	int level = SD0_DEFAULT_LEVEL;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:l:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			rounds = std::stoi(optarg);
+			break;
+
+			case 'l':
+			level = std::stoi(optarg);
+			break;
+		}
+	}
+
+	std::vector<std::string> inputs;
+	for (int i = optind; i < argc; i++)
+	{
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Could not read '" << argv[i] << "'" << std::endl;
+			return 1;
+		}
+		std::stringstream data;
+		data << file.rdbuf();
+		inputs.push_back(data.str());
+	}
+
+	/* Without files, use 64 MiB of data that compresses about as well as terrain */
+	if (inputs.empty())
+	{
+		std::mt19937 random(42);
+		std::string data(64 << 20, 0);
+		for (std::size_t i = 0; i < data.size(); i++)
+		{
+			data[i] = (random() & 0x0F) == 0 ? (char) random() : (char) ((i >> 6) & 0x3F);
+		}
+		inputs.push_back(make_sd0(data));
+	}
+
+	/* Every backend works on the same blocks */
+	std::vector<std::pair<const char*, uint32_t>> blocks;
+	for (std::size_t i = 0; i < inputs.size(); i++)
+	{
+		std::vector<sd0_block> found;
+		if (!sd0_scan(inputs[i].data(), inputs[i].size(), found))
+		{
+			std::cerr << "Input " << i << " is not an sd0 file" << std::endl;
+			return 1;
+		}
+		for (const sd0_block& block : found) blocks.push_back({inputs[i].data() + block.offset, block.size});
+	}
+
+	std::vector<std::string> names = codec_names();
+	std::cout << "Blocks: " << blocks.size() << ", Level: " << level << ", Default: " << default_codec_name() << std::endl;
+
+	std::vector<std::string> reference;
+	std::vector<std::string> encoded(blocks.size());
+	std::vector<char> decoded(SD0_BLOCK_SIZE);
+
+	for (const std::string& name : names)
+	{
+		std::unique_ptr<codec> backend = create_codec(name, level);
+		if (!backend)
+		{
+			std::cerr << "Could not set up '" << name << "'" << std::endl;
+			return 2;
+		}
+
+		std::vector<std::string> result(blocks.size());
+		uint64_t bytes = 0;
+		bench_clock::time_point start = bench_clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			bytes = 0;
+			for (std::size_t i = 0; i < blocks.size(); i++)
+			{
+				int64_t size = backend->inflate(blocks[i].first, blocks[i].second, decoded.data(), decoded.size());
+				if (size < 0)
+				{
+					std::cerr << name << " could not inflate block " << i << std::endl;
+					return 2;
+				}
+				if (r == 0) result[i].assign(decoded.data(), size);
+				bytes += size;
+			}
+		}
+		bench_report_bytes(name + " in", (bench_clock::now() - start) / rounds, bytes);
+
+		/* Different backends compress differently, but have to inflate to the same data */
+		if (reference.empty()) reference = result;
+		else if (result != reference)
+		{
+			std::cerr << "Mismatch between " << names[0] << " and " << name << "!" << std::endl;
+			return 2;
+		}
+
+		std::vector<char> out;
+		uint64_t compressed = 0;
+		start = bench_clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			compressed = 0;
+			for (std::size_t i = 0; i < blocks.size(); i++)
+			{
+				out.resize(backend->deflate_bound(reference[i].size()));
+				int64_t size = backend->deflate(reference[i].data(), reference[i].size(), out.data(), out.size());
+				if (size < 0)
+				{
+					std::cerr << name << " could not deflate block " << i << std::endl;
+					return 2;
+				}
+				if (r == 0) encoded[i].assign(out.data(), size);
+				compressed += size;
+			}
+		}
+		bench_report_bytes(name + " out", (bench_clock::now() - start) / rounds, bytes);
+		std::cout << std::setw(12) << "ratio" << ": " << std::setw(8) << (100.0 * compressed / bytes) << " %" << std::endl;
+
+		/* The output has to be readable by zlib, which the client uses */
+		std::unique_ptr<codec> check = create_codec("zlib", level);
+		for (std::size_t i = 0; i < blocks.size(); i++)
+		{
+			int64_t size = check->inflate(encoded[i].data(), encoded[i].size(), decoded.data(), decoded.size());
+			if (size != (int64_t) reference[i].size() || reference[i].compare(0, size, decoded.data(), size) != 0)
+			{
+				std::cerr << "Block " << i << " from " << name << " does not round-trip!" << std::endl;
+				return 2;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ *	Computes the MD5 of a buffer with md5.c
+ */
+static void md5_reference(const md5_buffer& buffer, uint8_t digest[16])
+{
+	md5_state_t state;
+	md5_init(&state);
+	md5_append(&state, (const md5_byte_t*) buffer.data, buffer.length);
+	md5_finish(&state, digest);
+}
+
+int bench_md5(int argc, char** argv)
+{
+	int rounds = 10;
+	std::size_t size = 65536;
+	std::size_t count = 256;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:s:c:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			rounds = std::stoi(optarg);
+			break;
+
+			case 's':
+			size = std::stoul(optarg);
+			break;
+
+			case 'c':
+			count = std::stoul(optarg);
+			break;
+		}
+	}
+
+	std::mt19937 random(42);
+	std::string data(size * count + 4096, 0);
+	for (char& c : data) c = (char) random();
+
+	/* Lengths around the padding edges and odd batch sizes first, against md5.c */
+	std::vector<md5_buffer> tests;
+	for (std::size_t length = 0; length <= 260; length++)
+	{
+		tests.push_back({data.data() + length, length, {0}});
+	}
+	for (int i = 0; i < 300; i++)
+	{
+		tests.push_back({data.data() + random() % 4096, random() % std::min<std::size_t>(data.size() - 4096, 1 << 20), {0}});
+	}
+
+	std::vector<md5_buffer> batch(count);
+	for (std::size_t i = 0; i < count; i++) batch[i] = {data.data() + i * size, size, {0}};
+
+	std::cout << "Buffers: " << count << " x " << size << " B, Default: " << md5_multi_engine() << std::endl;
+
+	std::string previous = md5_multi_engine();
+	for (std::size_t e = 0; e < md5_multi_engine_count(); e++)
+	{
+		const char* name = md5_multi_engine_name(e);
+		if (!md5_multi_select(name))
+		{
+			std::cout << std::setw(12) << name << ": not supported" << std::endl;
+			continue;
+		}
+
+		for (std::size_t start = 0, step = 1; start < tests.size(); start += step, step = step % 37 + 1)
+		{
+			std::size_t n = std::min(step, tests.size() - start);
+			md5_multi(tests.data() + start, n);
+
+			for (std::size_t i = start; i < start + n; i++)
+			{
+				uint8_t expected[16];
+				md5_reference(tests[i], expected);
+				if (memcmp(expected, tests[i].digest, 16) != 0)
+				{
+					std::cerr << name << " is wrong for " << tests[i].length << " bytes!" << std::endl;
+					md5_multi_select(previous.c_str());
+					return 2;
+				}
+			}
+		}
+
+		bench_clock::time_point start = bench_clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			md5_multi(batch.data(), batch.size());
+		}
+		bench_report_bytes(name, (bench_clock::now() - start) / rounds, size * count);
+	}
+
+	md5_multi_select(previous.c_str());
+	return 0;
+}
+
+int bench_chain(int argc, char** argv)
+{
+	int rounds = 5;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+			rounds = std::stoi(optarg);
+			break;
+		}
+	}
+
+	std::vector<std::string> inputs;
+	for (int i = optind; i < argc; i++)
+	{
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Could not read '" << argv[i] << "'" << std::endl;
+			return 1;
+		}
+		std::stringstream data;
+		data << file.rdbuf();
+		inputs.push_back(data.str());
+	}
+
+	/* Without files, use 64 MiB of data that compresses about as well as terrain */
+	if (inputs.empty())
+	{
+		std::mt19937 random(42);
+		std::string data(64 << 20, 0);
+		for (std::size_t i = 0; i < data.size(); i++)
+		{
+			data[i] = (random() & 0x0F) == 0 ? (char) random() : (char) ((i >> 6) & 0x3F);
+		}
+		inputs.push_back(make_sd0(data));
+	}
+
+	std::cout << "Files: " << inputs.size() << ", Chain: sd0 >> md5" << std::endl;
+
+	/* The runtime chain, as built by pipe -s --md5 */
+	std::vector<std::string> dynamic(inputs.size());
+	uint64_t bytes = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		InputStage* input = new GenericInputStage(new InitialInputStage(), &create_sd0_stream, "SD0");
+		MD5TransformStage transform;
+		for (std::size_t i = 0; i < inputs.size(); i++)
+		{
+			std::istringstream source(inputs[i]);
+			std::ostringstream sink;
+			transform.run(input->getStream(&source), &sink);
+			input->cleanup();
+			dynamic[i] = sink.str();
+		}
+		delete input;
+	}
+	bench_clock::duration time = bench_clock::now() - start;
+
+	/* The same chain as one type, from a stream and from memory */
+	std::vector<std::string> fixed(inputs.size());
+	bench_clock::duration streamTime, spanTime;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		start = bench_clock::now();
+		for (int r = 0; r < rounds; r++)
+		{
+			bytes = 0;
+			for (std::size_t i = 0; i < inputs.size(); i++)
+			{
+				sd0_filter<md5_sink> chain;
+				bool ok;
+				if (mode == 0)
+				{
+					std::istringstream source(inputs[i]);
+					ok = static_pump(&source, chain);
+				}
+				else
+				{
+					ok = chain.write(inputs[i].data(), inputs[i].size()) && chain.finish();
+				}
+
+				if (!ok)
+				{
+					std::cerr << "Could not decode input " << i << std::endl;
+					return 2;
+				}
+
+				std::ostringstream line;
+				line << std::hex;
+				for (int b = 0; b < 16; b++) line << std::setw(2) << std::setfill('0') << (int) chain.next().digest()[b];
+				line << std::dec << " - " << chain.next().size() << " Bytes" << std::endl;
+				fixed[i] = line.str();
+				bytes += chain.next().size();
+			}
+		}
+		(mode == 0 ? streamTime : spanTime) = bench_clock::now() - start;
+
+		if (fixed != dynamic)
+		{
+			std::cerr << "Mismatch between the static and dynamic chain!" << std::endl;
+			return 2;
+		}
+	}
+
+	bench_report_bytes("dynamic", time / rounds, bytes);
+	bench_report_bytes("static", streamTime / rounds, bytes);
+	bench_report_bytes("static span", spanTime / rounds, bytes);
+	return 0;
+}
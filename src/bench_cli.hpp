@@ -0,0 +1,12 @@
+#pragma once
+
+int main_bench(int argc, char** argv);
+int help_bench(int argc, char** argv);
+
+int bench_crc(int argc, char** argv);
+int bench_sd0(int argc, char** argv);
+int bench_seek(int argc, char** argv);
+int bench_stream(int argc, char** argv);
+int bench_codec(int argc, char** argv);
+int bench_md5(int argc, char** argv);
+int bench_chain(int argc, char** argv);
@@ -0,0 +1,230 @@
+#include "cache_extract.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <cstdio>
+#include <cstring>
+
+#include <assembly/filesystem.hpp>
+
+#include "parallel.hpp"
+#include "mapped_file.hpp"
+#include "file_writer.hpp"
+#include "sd0_codec.hpp"
+#include "pack_index.hpp"
+#include "md5.h"
+
+using namespace assembly::manifest;
+
+/**
+ *	Reads the checksum of a manifest entry, returns false if it has none
+ */
+static bool parse_checksum(const std::string& hex, uint8_t md5[16])
+{
+	return hex.size() >= 32 && md5_from_hex(hex.c_str(), md5);
+}
+
+cache_extractor::cache_extractor(const std::string& folder) : folder(folder)
+{
+}
+
+cache_stats cache_extractor::run(const std::vector<manifest_entry>& files, unsigned threads)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	failed.clear();
+
+	/* Start with the largest objects, so that the last ones are small */
+	std::vector<std::size_t> order(files.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&files](std::size_t a, std::size_t b)
+	{
+		return files[a].sizeB > files[b].sizeB;
+	});
+
+	/* Creating directories is not safe to do concurrently */
+	std::set<std::string> dirs;
+	for (const manifest_entry& entry : files)
+	{
+		if (dirs.insert(entry.path.substr(0, entry.path.find_last_of('/') + 1)).second)
+		{
+			fs::ensure_dir_exists(entry.path);
+		}
+	}
+
+	std::vector<std::string> reasons(files.size());
+	std::vector<char> missing(files.size(), 0);
+	std::vector<char> written(files.size(), 0);		// Whether a bad output has to be removed
+	std::vector<char> writeFailed(files.size(), 0);	// Set by the writer, read once it is done
+
+	std::atomic<uint64_t> done(0), missingCount(0), failedCount(0), bytesIn(0), bytesOut(0);
+	std::mutex logMutex;
+
+	if (threads == 0) threads = parallel::default_threads();
+	std::vector<std::unique_ptr<sd0_decoder>> decoders(threads);
+	file_writer writer;
+
+	parallel::for_each(order.size(), threads, [&](std::size_t i, unsigned worker)
+	{
+		std::size_t index = order[i];
+		const manifest_entry& entry = files[index];
+
+		auto fail = [&](const std::string& reason)
+		{
+			reasons[index] = reason;
+			failedCount++;
+			if (verbose)
+			{
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cerr << "Failed " << entry.path << ": " << reason << std::endl;
+			}
+		};
+
+		mapped_file object;
+		if (!object.open(folder + entry.checkA + ".sd0"))
+		{
+			reasons[index] = "not in the cache";
+			missing[index] = 1;
+			missingCount++;
+			return;
+		}
+		object.advise(MADV_SEQUENTIAL);
+		bytesIn += object.size();
+
+		if (entry.sizeB != 0 && object.size() != entry.sizeB)
+		{
+			fail("object has " + std::to_string(object.size()) + " bytes, expected " + std::to_string(entry.sizeB));
+			return;
+		}
+
+		std::vector<sd0_block> blocks;
+		if (!sd0_scan(object.data(), object.size(), blocks))
+		{
+			fail("object is not sd0 compressed");
+			return;
+		}
+
+		int fd = writer.open(entry.path, entry.sizeA, &writeFailed[index]);
+		if (fd < 0)
+		{
+			fail("could not create the output");
+			return;
+		}
+		written[index] = 1;
+
+		if (!decoders[worker]) decoders[worker].reset(new sd0_decoder());
+		sd0_decoder& decoder = *decoders[worker];
+
+		/* Both checksums are computed as the blocks go by */
+		md5_state_t stored, inflated;
+		md5_init(&stored);
+		md5_init(&inflated);
+		std::size_t hashed = 0;
+
+		std::vector<char> chunk = writer.buffer();
+		uint64_t size = 0;
+		bool ok = true;
+
+		for (const sd0_block& block : blocks)
+		{
+			if (chunk.size() + SD0_BLOCK_SIZE > FILE_WRITER_CHUNK_SIZE)
+			{
+				md5_append(&inflated, (const md5_byte_t*) chunk.data(), chunk.size());
+				size += chunk.size();
+				writer.write(fd, std::move(chunk));
+				chunk = writer.buffer();
+			}
+
+			md5_append(&stored, (const md5_byte_t*) object.data() + hashed, block.offset + block.size - hashed);
+			hashed = block.offset + block.size;
+
+			if (!decoder.decode_block(object.data() + block.offset, block.size, chunk))
+			{
+				ok = false;
+				break;
+			}
+		}
+
+		if (!chunk.empty())
+		{
+			md5_append(&inflated, (const md5_byte_t*) chunk.data(), chunk.size());
+			size += chunk.size();
+			writer.write(fd, std::move(chunk));
+		}
+		writer.close(fd, size, entry.sizeA > 0);
+
+		md5_append(&stored, (const md5_byte_t*) object.data() + hashed, object.size() - hashed);
+
+		md5_byte_t digest[16], expected[16];
+		if (!ok)
+		{
+			fail("could not inflate the object");
+			return;
+		}
+
+		md5_finish(&stored, digest);
+		if (parse_checksum(entry.checkB, expected) && memcmp(digest, expected, 16) != 0)
+		{
+			fail("MD5 of the object does not match");
+			return;
+		}
+
+		if (size != entry.sizeA)
+		{
+			fail("inflated to " + std::to_string(size) + " bytes, expected " + std::to_string(entry.sizeA));
+			return;
+		}
+
+		md5_finish(&inflated, digest);
+		if (parse_checksum(entry.checkA, expected) && memcmp(digest, expected, 16) != 0)
+		{
+			fail("MD5 of the output does not match");
+			return;
+		}
+
+		written[index] = 0;
+		done++;
+		bytesOut += size;
+
+		if (verbose)
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cout << "Extracted: " << entry.path << std::endl;
+		}
+	});
+
+	writer.wait();
+
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		/* A file that checked out can still fail on its way to the disk */
+		if (writeFailed[i] && reasons[i].empty())
+		{
+			reasons[i] = "could not write the output";
+			written[i] = 1;
+			failedCount++;
+			done--;
+			bytesOut -= files[i].sizeA;
+			if (verbose) std::cerr << "Failed " << files[i].path << ": " << reasons[i] << std::endl;
+		}
+
+
+		if (reasons[i].empty()) continue;
+		if (written[i]) remove(files[i].path.c_str());
+		failed.push_back({files[i].path, folder + files[i].checkA + ".sd0", reasons[i], missing[i] != 0});
+	}
+
+	cache_stats stats;
+	stats.files = done;
+	stats.missing = missingCount;
+	stats.failed = failedCount;
+	stats.bytesIn = bytesIn;
+	stats.bytesOut = bytesOut;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <assembly/manifest.hpp>
+
+/**
+ *	The totals of an extraction from the patcher cache
+ */
+struct cache_stats
+{
+	uint64_t files = 0;		// Files written and verified
+	uint64_t missing = 0;	// Files without an object in the cache
+	uint64_t failed = 0;	// Files that could not be read, written or verified
+	uint64_t bytesIn = 0;	// Bytes read from the cache
+	uint64_t bytesOut = 0;	// Bytes written to the output
+	double seconds = 0;
+};
+
+/**
+ *	A manifest entry that could not be extracted
+ */
+struct cache_failure
+{
+	std::string path;
+	std::string object;		// The file in the cache
+	std::string reason;
+	bool missing;			// Whether the object is not in the cache at all
+};
+
+/*
+ * Extracts the files of a manifest from a patcher cache, that is a folder
+ * with one sd0 object per file, named after the MD5 of its content.
+ *
+ * The files are handed out to the worker threads, largest first. Each
+ * worker maps the object and inflates it block by block into chunks that
+ * are queued for a background writer. The MD5s of the object and of the
+ * output are computed on the way and checked against the manifest, as
+ * are both sizes. The outputs are reserved at their size from the
+ * manifest up front. A file whose size or MD5 does not match the
+ * manifest, or that the writer failed on, is removed again once the
+ * writer is done, so that a second run never takes it for good.
+ */
+class cache_extractor {
+
+	std::string folder;
+	std::vector<cache_failure> failed;
+
+public:
+	bool verbose = false;
+
+	cache_extractor(const std::string& folder);
+
+	// Extracts the files of a manifest on `threads` threads (0 for all cores)
+	cache_stats run(const std::vector<assembly::manifest::manifest_entry>& files, unsigned threads);
+
+	// The entries that failed or were missing in the last run, in the order of the manifest
+	const std::vector<cache_failure>& failures() const { return failed; }
+};
@@ -0,0 +1,144 @@
+#include "catalog_view.hpp"
+
+#include <cstring>
+
+#define CATALOG_RECORD_SIZE 20
+
+static inline uint32_t read_u32(const char* p)
+{
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+bool catalog_view::open(const std::string& path)
+{
+	close();
+	if (!file.open(path)) return false;
+
+	const char* pos = file.data();
+	const char* end = pos + file.size();
+
+	if (end - pos < 8)
+	{
+		close();
+		return false;
+	}
+
+	uint32_t version = read_u32(pos);
+	uint32_t count = read_u32(pos + 4);
+	pos += 8;
+
+	/* The pack names have variable length, so walk them once */
+	const char* first = pos;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (end - pos < 4 || (uint32_t) (end - pos - 4) < read_u32(pos))
+		{
+			close();
+			return false;
+		}
+		pos += 4 + read_u32(pos);
+	}
+
+	if (end - pos < 4)
+	{
+		close();
+		return false;
+	}
+
+	uint32_t records = read_u32(pos);
+	pos += 4;
+
+	if ((uint64_t) (end - pos) < (uint64_t) records * CATALOG_RECORD_SIZE)
+	{
+		close();
+		return false;
+	}
+
+	fileVersion = version;
+	packCount = count;
+	fileCount = records;
+	packs = first;
+	files = pos;
+	return true;
+}
+
+void catalog_view::close()
+{
+	file.close();
+	fileVersion = packCount = fileCount = 0;
+	packs = files = nullptr;
+}
+
+catalog_record catalog_view::entry(uint32_t index) const
+{
+	catalog_record record;
+	memcpy(&record, files + (size_t) index * CATALOG_RECORD_SIZE, CATALOG_RECORD_SIZE);
+	return record;
+}
+
+int32_t catalog_view::find(uint32_t crc) const
+{
+	int64_t index = (fileCount > 0) ? fileCount / 2 : -1;
+
+	/* A broken tree could have cycles, but never needs more steps than entries */
+	for (uint32_t steps = 0; index >= 0 && index < fileCount && steps <= fileCount; steps++)
+	{
+		const char* record = files + (size_t) index * CATALOG_RECORD_SIZE;
+		uint32_t value = read_u32(record);
+		if (value == crc) return (int32_t) index;
+
+		index = (int32_t) read_u32(record + (value > crc ? 4 : 8));
+	}
+
+	return -1;
+}
+
+bool catalog_view::pack_name(uint32_t index, const char*& name, uint32_t& length) const
+{
+	if (index >= packCount) return false;
+
+	const char* pos = packs;
+	for (uint32_t i = 0; i < index; i++)
+	{
+		pos += 4 + read_u32(pos);
+	}
+
+	length = read_u32(pos);
+	name = pos + 4;
+	return true;
+}
+
+std::string catalog_view::pack_name(uint32_t index) const
+{
+	const char* name;
+	uint32_t length;
+	if (!pack_name(index, name, length)) return std::string();
+	return std::string(name, length);
+}
+
+static inline char normalize(char c)
+{
+	if (c == '/') return '\\';
+	if ('A' <= c && c <= 'Z') return c + ('a' - 'A');
+	return c;
+}
+
+int32_t catalog_view::pack_index(const std::string& name) const
+{
+	const char* pos = packs;
+	for (uint32_t i = 0; i < packCount; i++)
+	{
+		uint32_t length = read_u32(pos);
+		const char* str = pos + 4;
+		pos += 4 + length;
+
+		if (length != name.size()) continue;
+
+		uint32_t k = 0;
+		while (k < length && normalize(str[k]) == normalize(name[k])) k++;
+		if (k == length) return i;
+	}
+	return -1;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "mapped_file.hpp"
+
+/**
+ *	One file entry of a catalog, the nodes of a binary tree over the CRCs
+ */
+struct catalog_record
+{
+	uint32_t crc;
+	int32_t left;
+	int32_t right;
+	uint32_t pack;
+	uint32_t data;
+};
+
+/*
+ * A read-only view of a pack catalog (*.pki), straight from a mapping of
+ * the file. Opening only checks that the header and the tables fit into
+ * the file, nothing is copied to the heap.
+ *
+ * Layout: version, pack count, (length, name) per pack, file count and
+ * a 20 byte catalog_record per file, all integers little-endian.
+ */
+class catalog_view {
+
+	mapped_file file;
+	uint32_t fileVersion = 0;
+	uint32_t packCount = 0;
+	uint32_t fileCount = 0;
+	const char* packs = nullptr;	// The first pack name record
+	const char* files = nullptr;	// The first file record
+
+public:
+	// Maps and validates a catalog, returns false if it is not one
+	bool open(const std::string& path);
+
+	// Unmaps the catalog
+	void close();
+
+	bool is_open() const { return files != nullptr; }
+	uint32_t version() const { return fileVersion; }
+	uint32_t pack_count() const { return packCount; }
+	uint32_t file_count() const { return fileCount; }
+
+	// Returns the file entry at the index
+	catalog_record entry(uint32_t index) const;
+
+	// Returns the index of the entry for a CRC, or -1
+	int32_t find(uint32_t crc) const;
+
+	// Sets name and length to the path of a pack, returns false for invalid indices
+	bool pack_name(uint32_t index, const char*& name, uint32_t& length) const;
+
+	// Returns the path of a pack, or an empty string for invalid indices
+	std::string pack_name(uint32_t index) const;
+
+	// Returns the index of the pack with this path (ignoring case and slash direction), or -1
+	int32_t pack_index(const std::string& name) const;
+};
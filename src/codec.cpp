@@ -0,0 +1,235 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <zlib.h>
+
+#include "../config.h"
+
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+/*
+ * The zlib backend, with inflate and deflate states that are reset
+ * instead of being set up again for every block. The deflate state is
+ * only set up once it is needed, as most instances never deflate.
+ */
+class zlib_codec : public codec {
+
+	z_stream i_stream;
+	z_stream d_stream;
+	int level;
+	bool inflateOpen;
+	bool deflateOpen = false;
+	bool deflateTried = false;
+	bool streamEnded = false;	// Whether inflate_stream reached the end of its stream
+
+	bool open_deflate()
+	{
+		if (!deflateTried)
+		{
+			deflateTried = true;
+			deflateOpen = deflateInit(&d_stream, level < 0 ? Z_DEFAULT_COMPRESSION : std::min(level, 9)) == Z_OK;
+		}
+		return deflateOpen;
+	}
+
+public:
+	zlib_codec(int level) : level(level)
+	{
+		i_stream.zalloc = d_stream.zalloc = (alloc_func) 0;
+		i_stream.zfree = d_stream.zfree = (free_func) 0;
+		i_stream.opaque = d_stream.opaque = (voidpf) 0;
+		i_stream.avail_in = 0;
+		i_stream.next_in = Z_NULL;
+		inflateOpen = inflateInit(&i_stream) == Z_OK;
+	}
+
+	~zlib_codec()
+	{
+		if (inflateOpen) inflateEnd(&i_stream);
+		if (deflateOpen) deflateEnd(&d_stream);
+	}
+
+	const char* name() const { return "zlib"; }
+
+	int64_t inflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		if (!inflateOpen || srcLength > UINT_MAX || dstLength > UINT_MAX) return CODEC_ERROR;
+
+		Bytef empty;	// zlib refuses a null output pointer, even for empty output
+
+		inflateReset(&i_stream);
+		i_stream.next_in = (Bytef*) src;
+		i_stream.avail_in = srcLength;
+		i_stream.next_out = dst ? (Bytef*) dst : &empty;
+		i_stream.avail_out = dst ? dstLength : 0;
+
+		int err = ::inflate(&i_stream, Z_FINISH);
+		if (err == Z_STREAM_END) return (dst ? dstLength : 0) - i_stream.avail_out;
+
+		/* Out of output space with input left means the buffer is too small */
+		if (err == Z_BUF_ERROR && i_stream.avail_out == 0) return CODEC_SHORT;
+		return CODEC_ERROR;
+	}
+
+	int64_t deflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		if (!open_deflate() || srcLength > UINT_MAX || dstLength > UINT_MAX) return CODEC_ERROR;
+
+		deflateReset(&d_stream);
+		d_stream.next_in = (Bytef*) src;
+		d_stream.avail_in = srcLength;
+		d_stream.next_out = (Bytef*) dst;
+		d_stream.avail_out = dstLength;
+
+		int err = ::deflate(&d_stream, Z_FINISH);
+		if (err != Z_STREAM_END) return CODEC_ERROR;
+		return dstLength - d_stream.avail_out;
+	}
+
+	std::size_t deflate_bound(std::size_t srcLength)
+	{
+		if (!open_deflate()) return compressBound(srcLength);
+		return deflateBound(&d_stream, srcLength);
+	}
+
+	void inflate_reset()
+	{
+		if (inflateOpen) inflateReset(&i_stream);
+		streamEnded = false;
+	}
+
+	inflate_status inflate_stream(const char*& in, std::size_t& inLength, char*& out, std::size_t& outLength)
+	{
+		if (!inflateOpen) return INFLATE_ERROR;
+		if (streamEnded) return INFLATE_END;
+
+		uInt availIn = std::min<std::size_t>(inLength, UINT_MAX);
+		uInt availOut = std::min<std::size_t>(outLength, UINT_MAX);
+
+		i_stream.next_in = (Bytef*) in;
+		i_stream.avail_in = availIn;
+		i_stream.next_out = (Bytef*) out;
+		i_stream.avail_out = availOut;
+
+		int err = ::inflate(&i_stream, Z_NO_FLUSH);
+
+		in += availIn - i_stream.avail_in;
+		inLength -= availIn - i_stream.avail_in;
+		out += availOut - i_stream.avail_out;
+		outLength -= availOut - i_stream.avail_out;
+
+		if (err == Z_STREAM_END)
+		{
+			streamEnded = true;
+			return INFLATE_END;
+		}
+		return (err == Z_OK || err == Z_BUF_ERROR) ? INFLATE_OK : INFLATE_ERROR;
+	}
+};
+
+#ifdef HAVE_LIBDEFLATE
+
+/*
+ * The libdeflate backend, which only does whole buffers but is much
+ * faster than zlib at that. Streams go through zlib.
+ */
+class libdeflate_codec : public codec {
+
+	libdeflate_decompressor* decompressor;
+	libdeflate_compressor* compressor;
+	std::unique_ptr<zlib_codec> streaming;	// Set up for the first stream
+
+public:
+	libdeflate_codec(int level)
+	{
+		/* Levels go up to 12 here, and there is no default level like -1 in zlib */
+		decompressor = libdeflate_alloc_decompressor();
+		compressor = libdeflate_alloc_compressor(level < 0 ? 6 : std::min(level, 12));
+	}
+
+	~libdeflate_codec()
+	{
+		if (decompressor) libdeflate_free_decompressor(decompressor);
+		if (compressor) libdeflate_free_compressor(compressor);
+	}
+
+	const char* name() const { return "libdeflate"; }
+
+	int64_t inflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		if (!decompressor) return CODEC_ERROR;
+
+		std::size_t written = 0;
+		libdeflate_result result = libdeflate_zlib_decompress(decompressor, src, srcLength, dst, dstLength, &written);
+		if (result == LIBDEFLATE_SUCCESS) return written;
+		if (result == LIBDEFLATE_INSUFFICIENT_SPACE) return CODEC_SHORT;
+		return CODEC_ERROR;
+	}
+
+	int64_t deflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		if (!compressor) return CODEC_ERROR;
+
+		std::size_t written = libdeflate_zlib_compress(compressor, src, srcLength, dst, dstLength);
+		return written > 0 ? (int64_t) written : CODEC_ERROR;
+	}
+
+	std::size_t deflate_bound(std::size_t srcLength)
+	{
+		if (!compressor) return compressBound(srcLength);
+		return libdeflate_zlib_compress_bound(compressor, srcLength);
+	}
+
+	void inflate_reset()
+	{
+		if (streaming) streaming->inflate_reset();
+	}
+
+	inflate_status inflate_stream(const char*& in, std::size_t& inLength, char*& out, std::size_t& outLength)
+	{
+		if (!streaming) streaming.reset(new zlib_codec(-1));
+		return streaming->inflate_stream(in, inLength, out, outLength);
+	}
+};
+
+#endif
+
+std::unique_ptr<codec> create_codec(const std::string& name, int level)
+{
+	const std::string& backend = name.empty() ? default_codec_name() : name;
+
+	if (backend == "zlib") return std::unique_ptr<codec>(new zlib_codec(level));
+#ifdef HAVE_LIBDEFLATE
+	if (backend == "libdeflate") return std::unique_ptr<codec>(new libdeflate_codec(level));
+#endif
+	return nullptr;
+}
+
+std::vector<std::string> codec_names()
+{
+	std::vector<std::string> names;
+	names.push_back("zlib");
+#ifdef HAVE_LIBDEFLATE
+	names.push_back("libdeflate");
+#endif
+	return names;
+}
+
+const std::string& default_codec_name()
+{
+	static const std::string name = []
+	{
+		const char* env = getenv("PARADOX_CODEC");
+		std::string selected = env ? env : "";
+		for (const std::string& known : codec_names())
+		{
+			if (known == selected) return selected;
+		}
+		return std::string("zlib");
+	}();
+	return name;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define CODEC_ERROR -1	// The compressed data is corrupt
+#define CODEC_SHORT -2	// The output buffer is too small
+
+/**
+ *	The result of one incremental inflate call
+ */
+enum inflate_status
+{
+	INFLATE_OK,		// Progress was made, or more input or output space is needed
+	INFLATE_END,	// The end of the compressed data was reached
+	INFLATE_ERROR	// The data is corrupt
+};
+
+/*
+ * A zlib (RFC 1950) backend. Blocks whose sizes are known up front, like
+ * sd0 blocks and pack entries, are done in one shot; streams of unknown
+ * length are inflated incrementally between caller provided spans.
+ * Instances keep their state between calls and are not thread-safe; use
+ * one per thread, and one stream at a time.
+ *
+ * zlib is always available and the default. Other backends are compiled
+ * in when configure finds them, and PARADOX_CODEC=<name> selects one.
+ */
+class codec {
+public:
+	virtual ~codec() {}
+
+	// The name of the backend
+	virtual const char* name() const = 0;
+
+	// Inflates a complete zlib stream into dst, returns the size written, CODEC_ERROR or CODEC_SHORT
+	virtual int64_t inflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength) = 0;
+
+	// Deflates src into dst, returns the compressed size or CODEC_ERROR
+	virtual int64_t deflate(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength) = 0;
+
+	// The largest compressed size for srcLength bytes
+	virtual std::size_t deflate_bound(std::size_t srcLength) = 0;
+
+	// Starts over with a new stream for inflate_stream
+	virtual void inflate_reset() = 0;
+
+	// Inflates the next part of a stream from [in, in + inLength) into [out, out + outLength),
+	// and moves both spans past what was used. Nothing is buffered besides the window.
+	virtual inflate_status inflate_stream(const char*& in, std::size_t& inLength, char*& out, std::size_t& outLength) = 0;
+};
+
+// Creates a backend by name (empty for the default), or nullptr if it is not built in.
+// Levels beyond those of the backend are clamped, and below 0 select its default.
+std::unique_ptr<codec> create_codec(const std::string& name, int level);
+
+// The names of all backends that are built in
+std::vector<std::string> codec_names();
+
+// The name of the default backend
+const std::string& default_codec_name();
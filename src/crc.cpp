@@ -0,0 +1,208 @@
+#include "crc.hpp"
+
+#include <cstring>
+
+#define CRC_POLY 0x04C11DB7
+#define CRC_FXOR 0x00000000
+
+/**
+ *	The lookup tables for slicing-by-8.
+ *
+ *	`table[0][b]` is the value of `b << 24` after 8 shifts, `table[k][b]`
+ *	is the same value after another k zero bytes. `norm[b]` is the cleanup
+ *	of an input byte (lowercase, backslash as separator).
+ */
+struct crc_tables
+{
+	uint32_t table[8][256];
+	uint8_t norm[256];
+
+	crc_tables()
+	{
+		for (int b = 0; b < 256; b++)
+		{
+			uint32_t crc = (uint32_t) b << 24;
+			for (int i = 0; i < 8; i++)
+			{
+				crc = (crc & 0x80000000) ? (crc << 1) ^ CRC_POLY : (crc << 1);
+			}
+			table[0][b] = crc;
+
+			uint8_t n = (uint8_t) b;
+			if (n == '/') n = '\\';
+			if ('A' <= n && n <= 'Z') n += ('a' - 'A');
+			norm[b] = n;
+		}
+
+		for (int k = 1; k < 8; k++)
+		{
+			for (int b = 0; b < 256; b++)
+			{
+				uint32_t prev = table[k - 1][b];
+				table[k][b] = (prev << 8) ^ table[0][prev >> 24];
+			}
+		}
+	}
+};
+
+static const crc_tables tables;
+
+/**
+ *	Loads four bytes as a big-endian word, applying the input cleanup
+ */
+static inline uint32_t load_word(const uint8_t* p)
+{
+	const uint8_t* n = tables.norm;
+	return ((uint32_t) n[p[0]] << 24) | ((uint32_t) n[p[1]] << 16)
+	     | ((uint32_t) n[p[2]] << 8)  |  (uint32_t) n[p[3]];
+}
+
+/**
+ *	Advances the CRC over 8 bytes, given as two big-endian words
+ */
+static inline uint32_t step8(uint32_t crc, uint32_t hi, uint32_t lo)
+{
+	const uint32_t (*t)[256] = tables.table;
+	hi ^= crc;
+	return t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xFF] ^ t[5][(hi >> 8) & 0xFF] ^ t[4][hi & 0xFF]
+	     ^ t[3][lo >> 24] ^ t[2][(lo >> 16) & 0xFF] ^ t[1][(lo >> 8) & 0xFF] ^ t[0][lo & 0xFF];
+}
+
+/**
+ *	Advances the CRC over 4 bytes, given as a big-endian word
+ */
+static inline uint32_t step4(uint32_t crc, uint32_t word)
+{
+	const uint32_t (*t)[256] = tables.table;
+	word ^= crc;
+	return t[3][word >> 24] ^ t[2][(word >> 16) & 0xFF] ^ t[1][(word >> 8) & 0xFF] ^ t[0][word & 0xFF];
+}
+
+/**
+ *	Advances the CRC over a single byte
+ */
+static inline uint32_t step1(uint32_t crc, uint8_t b)
+{
+	return (crc << 8) ^ tables.table[0][(crc >> 24) ^ b];
+}
+
+uint32_t crc::update(uint32_t crc, const char* data, size_t length)
+{
+	const uint8_t* p = (const uint8_t*) data;
+	for (; length >= 8; p += 8, length -= 8)
+	{
+		crc = step8(crc, load_word(p), load_word(p + 4));
+	}
+	if (length >= 4)
+	{
+		crc = step4(crc, load_word(p));
+		p += 4; length -= 4;
+	}
+	for (; length > 0; p++, length--)
+	{
+		crc = step1(crc, tables.norm[*p]);
+	}
+	return crc;
+}
+
+uint32_t crc::zeros(uint32_t crc, size_t count)
+{
+	for (; count >= 8; count -= 8)
+	{
+		crc = step8(crc, 0, 0);
+	}
+	if (count >= 4)
+	{
+		crc = step4(crc, 0);
+		count -= 4;
+	}
+	for (; count > 0; count--)
+	{
+		crc = step1(crc, 0);
+	}
+	return crc;
+}
+
+uint32_t crc::finish(uint32_t crc)
+{
+	/* I have no clue why the four zero bytes were added */
+	return step4(crc, 0) ^ CRC_FXOR;
+}
+
+uint32_t crc::path(const char* str, size_t length)
+{
+	return finish(update(INIT, str, length));
+}
+
+uint32_t crc::path(const char* str)
+{
+	return path(str, strlen(str));
+}
+
+void crc::path_x4(const char* const str[4], const size_t length[4], uint32_t out[4])
+{
+	const uint8_t* p[4];
+	size_t common = length[0];
+	for (int i = 0; i < 4; i++)
+	{
+		p[i] = (const uint8_t*) str[i];
+		out[i] = INIT;
+		if (length[i] < common) common = length[i];
+	}
+
+	/* The four dependency chains are independent, so their loads overlap */
+	size_t done = common & ~(size_t) 7;
+	for (size_t pos = 0; pos < done; pos += 8)
+	{
+		out[0] = step8(out[0], load_word(p[0] + pos), load_word(p[0] + pos + 4));
+		out[1] = step8(out[1], load_word(p[1] + pos), load_word(p[1] + pos + 4));
+		out[2] = step8(out[2], load_word(p[2] + pos), load_word(p[2] + pos + 4));
+		out[3] = step8(out[3], load_word(p[3] + pos), load_word(p[3] + pos + 4));
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		out[i] = finish(update(out[i], str[i] + done, length[i] - done));
+	}
+}
+
+/**
+ *	Updates a CRC value for the next byte
+ */
+static void updateCRC(uint32_t& crc, uint8_t b)
+{
+	crc ^= (uint32_t) (b << 24); /* Move byte to MSB */
+	for (int i = 0; i < 8; i++)
+	{
+		if ((crc & 0x80000000) == 0)
+		{
+			crc <<= 1;
+		}
+		else
+		{
+			crc = (uint32_t) ((crc << 1) ^ CRC_POLY);
+		}
+	}
+}
+
+uint32_t crc::path_bitwise(const char* path)
+{
+	uint32_t crc = INIT;
+	/* Process the actual string */
+	for (int i = 0; path[i] != 0; i++)
+	{
+		/* Perform some cleanup on the input */
+		uint8_t b = (uint8_t) path[i];
+		if (b == '/') b = '\\';
+		if ('A' <= b && b <= 'Z') b += ('a' - 'A');
+
+		updateCRC(crc, b);
+	}
+	/* I have no clue why this was added */
+	for (int i = 0; i < 4; i++)
+	{
+		updateCRC(crc, 0);
+	}
+	crc ^= CRC_FXOR;
+	return crc;
+}
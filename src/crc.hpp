@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The variation of CRC-32 used for the filenames in the pack catalogs.
+ *
+ * It is computed MSB-first with polynomial 0x04C11DB7 and initial value
+ * 0xFFFFFFFF, after lowercasing the input and replacing '/' with '\'.
+ * Four zero bytes are appended to the input before the value is taken.
+ *
+ * The update functions are linear in the running value, so the CRC of
+ * `prefix + suffix` is `zeros(update(INIT, prefix), len(suffix)) ^ update(0, suffix)`.
+ */
+namespace crc
+{
+	const uint32_t INIT = 0xFFFFFFFF;
+
+	/**
+	 * Feeds `length` bytes of a path into the running CRC value
+	 */
+	uint32_t update(uint32_t crc, const char* data, size_t length);
+
+	/**
+	 * Feeds `count` zero bytes into the running CRC value
+	 */
+	uint32_t zeros(uint32_t crc, size_t count);
+
+	/**
+	 * Appends the trailing zero bytes and returns the final value
+	 */
+	uint32_t finish(uint32_t crc);
+
+	/**
+	 * Calculates the CRC of a path with known length
+	 */
+	uint32_t path(const char* str, size_t length);
+
+	/**
+	 * Calculates the CRC of a null-terminated path
+	 */
+	uint32_t path(const char* str);
+
+	/**
+	 * Calculates the CRC of four paths at once, interleaving the
+	 * table lookups of the independent streams.
+	 */
+	void path_x4(const char* const str[4], const size_t length[4], uint32_t out[4]);
+
+	/**
+	 * The original implementation, one bit at a time. Kept as
+	 * a reference to check and benchmark the table driven one.
+	 */
+	uint32_t path_bitwise(const char* str);
+}
@@ -0,0 +1,233 @@
+#include "file_writer.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <assembly/filesystem.hpp>
+
+#define FILE_WRITER_BATCH 64	// The most chunks passed to one writev
+
+file_writer::file_writer()
+{
+	worker = std::thread(&file_writer::work, this);
+}
+
+file_writer::~file_writer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	hasWork.notify_all();
+	worker.join();
+}
+
+int file_writer::open(const std::string& path, uint64_t expectedSize, char* failed)
+{
+	fs::ensure_dir_exists(path);
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+
+	/* Failing to reserve the space is not an error, it only makes the file more fragmented */
+	if (expectedSize > 0) posix_fallocate(fd, 0, expectedSize);
+
+	if (failed != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		flags[fd] = failed;
+	}
+	return fd;
+}
+
+void file_writer::push(op&& o)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	hasRoom.wait(lock, [this] { return pending < FILE_WRITER_PENDING; });
+	pending += o.data.size();
+	queue.push_back(std::move(o));
+	hasWork.notify_one();
+}
+
+void file_writer::write(int fd, std::vector<char>&& data)
+{
+	if (data.empty()) return;
+
+	op o;
+	o.fd = fd;
+	o.data = std::move(data);
+	push(std::move(o));
+}
+
+void file_writer::close(int fd, uint64_t size, bool sized)
+{
+	op o;
+	o.fd = fd;
+	o.close = true;
+	o.size = size;
+	o.sized = sized;
+	push(std::move(o));
+}
+
+std::vector<char> file_writer::buffer()
+{
+	std::vector<char> data;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!spare.empty())
+		{
+			data.swap(spare.back());
+			spare.pop_back();
+		}
+	}
+	data.clear();
+	data.reserve(FILE_WRITER_CHUNK_SIZE);
+	return data;
+}
+
+uint64_t file_writer::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	hasRoom.wait(lock, [this] { return queue.empty() && !busy; });
+	return failures;
+}
+
+void file_writer::work()
+{
+	std::vector<op> batch;
+	std::vector<struct iovec> vectors;
+
+	while (true)
+	{
+		char* flag = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			hasWork.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty()) return;
+
+			/* A run of chunks for the same file, or a single close */
+			int fd = queue.front().fd;
+			while (!queue.empty() && queue.front().fd == fd && batch.size() < FILE_WRITER_BATCH)
+			{
+				bool close = queue.front().close;
+				if (close && !batch.empty()) break;
+
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+				if (close) break;
+			}
+
+			/* Forget the flag before the close, the number may be handed out again right after */
+			auto found = flags.find(fd);
+			if (found != flags.end())
+			{
+				flag = found->second;
+				if (batch.front().close) flags.erase(found);
+			}
+			busy = true;
+		}
+
+		bool ok = true;
+		std::size_t bytes = 0;
+
+		if (batch.front().close)
+		{
+			const op& o = batch.front();
+			if (o.sized && ftruncate(o.fd, o.size) != 0) ok = false;
+			if (::close(o.fd) != 0) ok = false;
+		}
+		else
+		{
+			vectors.clear();
+			for (const op& o : batch)
+			{
+				vectors.push_back({(void*) o.data.data(), o.data.size()});
+				bytes += o.data.size();
+			}
+
+			/* Resume after short writes */
+			std::size_t first = 0;
+			while (first < vectors.size())
+			{
+				ssize_t done = writev(batch.front().fd, vectors.data() + first, std::min<std::size_t>(vectors.size() - first, IOV_MAX));
+				if (done < 0)
+				{
+					ok = false;
+					break;
+				}
+
+				while (first < vectors.size() && (std::size_t) done >= vectors[first].iov_len)
+				{
+					done -= vectors[first].iov_len;
+					first++;
+				}
+				if (first < vectors.size())
+				{
+					vectors[first].iov_base = (char*) vectors[first].iov_base + done;
+					vectors[first].iov_len -= done;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!ok)
+		{
+			failures++;
+			if (flag != nullptr) *flag = 1;
+		}
+		pending -= bytes;
+		for (op& o : batch)
+		{
+			if (o.data.capacity() > 0 && spare.size() < 2 * FILE_WRITER_BATCH) spare.push_back(std::move(o.data));
+		}
+		batch.clear();
+		busy = false;
+		hasRoom.notify_all();
+	}
+}
+
+file_writer_streambuf::file_writer_streambuf(file_writer* writer, int fd, uint64_t expectedSize)
+	: writer(writer), fd(fd), sized(expectedSize > 0), chunk(writer->buffer())
+{
+	chunk.resize(FILE_WRITER_CHUNK_SIZE);
+	setp(chunk.data(), chunk.data() + chunk.size());
+}
+
+file_writer_streambuf::~file_writer_streambuf()
+{
+	submit();
+	writer->close(fd, written, sized);
+}
+
+void file_writer_streambuf::submit()
+{
+	std::size_t length = pptr() - pbase();
+	if (length == 0) return;
+
+	chunk.resize(length);
+	written += length;
+	writer->write(fd, std::move(chunk));
+
+	chunk = writer->buffer();
+	chunk.resize(FILE_WRITER_CHUNK_SIZE);
+	setp(chunk.data(), chunk.data() + chunk.size());
+}
+
+file_writer_streambuf::int_type file_writer_streambuf::overflow(int_type c)
+{
+	submit();
+	if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+int file_writer_streambuf::sync()
+{
+	submit();
+	return 0;
+}
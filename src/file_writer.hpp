@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define FILE_WRITER_CHUNK_SIZE (1 << 20)
+#define FILE_WRITER_PENDING (64 << 20)	// The bytes that may wait to be written
+
+/*
+ * Writes files on a background thread.
+ *
+ * Files are opened (and created along with their directory) on the
+ * calling thread, so that errors show up right away, and pre-sized with
+ * fallocate when the final size is known. The data is queued in chunks
+ * that the writer thread passes to the system in batches, one writev per
+ * run of chunks for the same file, and closing is queued as well. A
+ * caller only waits when more than a fixed amount of data is pending.
+ * Errors are counted, and can be flagged for each file as well.
+ */
+class file_writer {
+
+	struct op
+	{
+		int fd;
+		std::vector<char> data;
+		bool close = false;
+		uint64_t size = 0;		// The size to truncate a pre-sized file to
+		bool sized = false;
+	};
+
+	std::deque<op> queue;
+	std::vector<std::vector<char>> spare;
+	std::size_t pending = 0;
+	bool busy = false;		// Whether the worker has a batch at hand
+	bool stopping = false;
+	uint64_t failures = 0;
+	std::unordered_map<int, char*> flags;	// The failure flags of the open files
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable hasWork;
+	std::condition_variable hasRoom;	// Data was written, or everything is done
+
+	void work();
+	void push(op&& o);
+
+public:
+	file_writer();
+	~file_writer();
+
+	file_writer(const file_writer&) = delete;
+	file_writer& operator=(const file_writer&) = delete;
+
+	// Creates a file for writing, pre-sized when expectedSize is not 0, returns -1 on error.
+	// If failed is given, it is set to 1 when a write or the close fails; read it after wait()
+	int open(const std::string& path, uint64_t expectedSize = 0, char* failed = nullptr);
+
+	// Queues data for a file
+	void write(int fd, std::vector<char>&& data);
+
+	// Queues closing a file, truncating it to size if it was pre-sized
+	void close(int fd, uint64_t size, bool sized);
+
+	// An empty buffer with room for a chunk
+	std::vector<char> buffer();
+
+	// Waits until everything queued so far is written, returns the number of failures so far
+	uint64_t wait();
+};
+
+/*
+ * A stream buffer that writes to a file through a file_writer. The last
+ * chunk is queued, and the file closed, when the buffer is destroyed.
+ */
+class file_writer_streambuf : public std::streambuf {
+
+	file_writer* writer;
+	int fd;
+	bool sized;
+	uint64_t written = 0;
+	std::vector<char> chunk;
+
+	// Queues the filled part of the chunk
+	void submit();
+
+public:
+	file_writer_streambuf(file_writer* writer, int fd, uint64_t expectedSize = 0);
+	~file_writer_streambuf();
+
+	int_type overflow(int_type c);
+	int sync();
+};
@@ -0,0 +1,68 @@
+#include "inflater.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "sd0_codec.hpp"
+
+sd0_inflater::sd0_inflater() : block(create_codec("", -1))
+{
+}
+
+inflate_status sd0_inflater::inflate(const char*& in, std::size_t& inLength, char*& out, std::size_t& outLength)
+{
+	while (outLength > 0)
+	{
+		if (state != BLOCK)
+		{
+			/* Collect the magic or a block length, which may come in pieces */
+			std::size_t size = state == MAGIC ? SD0_MAGIC_SIZE : 4;
+			std::size_t count = std::min(size - have, inLength);
+			memcpy(header + have, in, count);
+			have += count;
+			in += count;
+			inLength -= count;
+
+			if (have < size) return INFLATE_OK;
+			have = 0;
+
+			if (state == MAGIC)
+			{
+				if (!sd0_check_magic(header, SD0_MAGIC_SIZE)) return INFLATE_ERROR;
+				state = LENGTH;
+			}
+			else
+			{
+				memcpy(&remain, header, 4);
+				block->inflate_reset();
+				state = BLOCK;
+			}
+			continue;
+		}
+
+		std::size_t avail = std::min<std::size_t>(inLength, remain);
+		std::size_t before = avail;
+		char* start = out;
+
+		inflate_status status = block->inflate_stream(in, avail, out, outLength);
+		inLength -= before - avail;
+		remain -= before - avail;
+
+		if (status == INFLATE_ERROR) return INFLATE_ERROR;
+		if (status == INFLATE_END)
+		{
+			/* The zlib stream must fill its block exactly */
+			if (remain != 0) return INFLATE_ERROR;
+			state = LENGTH;
+			continue;
+		}
+
+		if (before == avail && out == start)
+		{
+			/* All of the block was read, but the stream did not end */
+			if (remain == 0) return INFLATE_ERROR;
+			return INFLATE_OK;
+		}
+	}
+	return INFLATE_OK;
+}
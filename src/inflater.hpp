@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+
+#include "codec.hpp"
+
+/*
+ * Incremental inflate of sd0 data between caller provided spans, like
+ * codec::inflate_stream, which each block goes through. The magic and
+ * the block lengths may be split across calls. sd0 data has no end
+ * marker, so the caller decides where it ends; at_boundary tells whether
+ * that is between two blocks.
+ */
+class sd0_inflater {
+
+	enum state_t { MAGIC, LENGTH, BLOCK };
+
+	std::unique_ptr<codec> block;
+	state_t state = MAGIC;
+	char header[5];			// The magic or length read so far
+	std::size_t have = 0;	// The number of bytes in header
+	uint32_t remain = 0;	// The compressed bytes left in the current block
+
+public:
+	sd0_inflater();
+
+	inflate_status inflate(const char*& in, std::size_t& inLength, char*& out, std::size_t& outLength);
+
+	// Whether all blocks seen so far are complete
+	bool at_boundary() const { return state == LENGTH && have == 0; }
+};
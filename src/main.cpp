@@ -8,6 +8,7 @@
 #include "pipe_cli.hpp"
 #include "net_cli.hpp"
 #include "data_cli.hpp"
+#include "bench_cli.hpp"
 
 #include "../config.h"
 
@@ -23,6 +24,7 @@ cli::opt_t main_options[] =
     {   "fdb",      &main_fdb,      "Manipulate a FileDataBase"     },
     {   "data",     &main_data,     "Manipulate data files"         },
     {   "net",      &main_net,      "Network helpers"               },
+    {   "bench",    &main_bench,    "Run micro-benchmarks"          },
     {   "test",     &main_test,     "Test some stuff"               },
     {   "help",     &main_help,     "Show this help"                },
 
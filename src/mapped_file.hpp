@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A read-only memory mapping of a whole file.
+ *
+ * The mapping stays valid as long as this object lives, so views
+ * into it must not outlive it. Moving transfers the mapping.
+ */
+class mapped_file {
+
+	const char* ptr = nullptr;	// The start of the mapping
+	std::size_t length = 0;		// The size of the file
+	bool mapped = false;		// Whether a file is open (it may be empty)
+
+public:
+	mapped_file() {}
+
+	explicit mapped_file(const std::string& path) {
+		open(path);
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	mapped_file(mapped_file&& other) : ptr(other.ptr), length(other.length), mapped(other.mapped) {
+		other.ptr = nullptr;
+		other.length = 0;
+		other.mapped = false;
+	}
+
+	mapped_file& operator=(mapped_file&& other) {
+		if (this != &other) {
+			close();
+			ptr = other.ptr;
+			length = other.length;
+			mapped = other.mapped;
+			other.ptr = nullptr;
+			other.length = 0;
+			other.mapped = false;
+		}
+		return *this;
+	}
+
+	~mapped_file() {
+		close();
+	}
+
+	// Maps the file at path, replacing any previous mapping
+	bool open(const std::string& path) {
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			return false;
+		}
+
+		length = st.st_size;
+		if (length > 0) {
+			void* addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			if (addr == MAP_FAILED) {
+				::close(fd);
+				length = 0;
+				return false;
+			}
+			ptr = (const char*) addr;
+		}
+
+		// The mapping keeps its own reference to the file
+		::close(fd);
+		mapped = true;
+		return true;
+	}
+
+	// Unmaps the file
+	void close() {
+		if (ptr != nullptr) munmap((void*) ptr, length);
+		ptr = nullptr;
+		length = 0;
+		mapped = false;
+	}
+
+	// Tells the kernel how the mapping will be read
+	void advise(int advice) const {
+		if (ptr != nullptr) madvise((void*) ptr, length, advice);
+	}
+
+	bool is_open() const { return mapped; }
+	const char* data() const { return ptr; }
+	std::size_t size() const { return length; }
+};
@@ -0,0 +1,270 @@
+#include "md5_multi.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstring>
+
+#include "md5.h"
+
+#define MD5_APPEND_MAX (1 << 30)	// md5_append takes an int
+
+static const uint32_t MD5_IV[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+/* The block functions, one per instruction set */
+#if defined(__x86_64__) || defined(__i386__)
+#define MD5_MULTI_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define MD5_LANES 4
+#define MD5_ENGINE md5_sse2
+#include "md5_multi_lanes.hpp"
+#undef MD5_LANES
+#undef MD5_ENGINE
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define MD5_LANES 8
+#define MD5_ENGINE md5_avx2
+#include "md5_multi_lanes.hpp"
+#undef MD5_LANES
+#undef MD5_ENGINE
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define MD5_LANES 16
+#define MD5_ENGINE md5_avx512
+#include "md5_multi_lanes.hpp"
+#undef MD5_LANES
+#undef MD5_ENGINE
+#pragma GCC pop_options
+
+#endif
+
+/**
+ *	Appends any number of bytes to a scalar state
+ */
+static void md5_append_all(md5_state_t* state, const uint8_t* data, std::size_t length)
+{
+	while (length > 0)
+	{
+		int chunk = (int) std::min<std::size_t>(length, MD5_APPEND_MAX);
+		md5_append(state, data, chunk);
+		data += chunk;
+		length -= chunk;
+	}
+}
+
+static void md5_scalar(md5_buffer* buffers, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+	{
+		md5_state_t state;
+		md5_init(&state);
+		md5_append_all(&state, (const uint8_t*) buffers[i].data, buffers[i].length);
+		md5_finish(&state, buffers[i].digest);
+	}
+}
+
+/**
+ *	The progress of one buffer through a lane. The buffer is read in
+ *	place, and the last one or two blocks with the padding are copied
+ *	to tail.
+ */
+struct md5_lane
+{
+	md5_buffer* job = nullptr;
+	const uint8_t* pos = nullptr;
+	std::size_t blocks = 0;		// Whole blocks of the buffer left
+	unsigned tailBlocks = 0;
+	unsigned tailDone = 0;
+	uint8_t tail[128];
+};
+
+/**
+ *	Runs the buffers through a block function of L lanes
+ */
+template<unsigned L>
+static void md5_lanes(md5_buffer* buffers, std::size_t count, void (*step)(uint32_t*, const uint8_t* const*))
+{
+	/* Longest first, so that the lanes run out of work at about the same time */
+	std::vector<md5_buffer*> jobs(count);
+	for (std::size_t i = 0; i < count; i++) jobs[i] = &buffers[i];
+	std::sort(jobs.begin(), jobs.end(), [](const md5_buffer* a, const md5_buffer* b) { return a->length > b->length; });
+
+	uint32_t state[4 * L] __attribute__((aligned(64))) = {0};
+	const uint8_t* blocks[L];
+	md5_lane lanes[L];
+	static const uint8_t idle[64] = {0};
+
+	std::size_t next = 0;
+	unsigned active = 0;
+
+	auto load = [&](unsigned l)
+	{
+		md5_lane& lane = lanes[l];
+		lane.job = next < count ? jobs[next++] : nullptr;
+		if (lane.job == nullptr) return;
+		active++;
+
+		std::size_t length = lane.job->length;
+		std::size_t rest = length % 64;
+		lane.pos = (const uint8_t*) lane.job->data;
+		lane.blocks = length / 64;
+		lane.tailBlocks = rest < 56 ? 1 : 2;
+		lane.tailDone = 0;
+
+		uint64_t bits = (uint64_t) length << 3;
+		memset(lane.tail, 0, sizeof(lane.tail));
+		if (rest > 0) memcpy(lane.tail, lane.pos + lane.blocks * 64, rest);
+		lane.tail[rest] = 0x80;
+		for (int i = 0; i < 8; i++) lane.tail[lane.tailBlocks * 64 - 8 + i] = (uint8_t) (bits >> (8 * i));
+
+		for (int w = 0; w < 4; w++) state[w * L + l] = MD5_IV[w];
+	};
+
+	auto finish = [&](unsigned l)
+	{
+		for (int w = 0; w < 4; w++)
+		{
+			uint32_t word = state[w * L + l];
+			for (int i = 0; i < 4; i++) lanes[l].job->digest[4 * w + i] = (uint8_t) (word >> (8 * i));
+		}
+		lanes[l].job = nullptr;
+		active--;
+	};
+
+	for (unsigned l = 0; l < L; l++) load(l);
+
+	while (active > 0)
+	{
+		/* With only a few lanes left busy, the scalar code is faster */
+		if (next == count && active <= L / 4)
+		{
+			for (unsigned l = 0; l < L; l++)
+			{
+				md5_lane& lane = lanes[l];
+				if (lane.job == nullptr || lane.tailDone > 0) continue;
+
+				md5_state_t scalar;
+				uint64_t done = lane.job->length - lane.job->length % 64 - lane.blocks * 64;
+				scalar.count[0] = (md5_word_t) (done << 3);
+				scalar.count[1] = (md5_word_t) (done >> 29);
+				for (int w = 0; w < 4; w++) scalar.abcd[w] = state[w * L + l];
+
+				md5_append_all(&scalar, lane.pos, lane.job->length - done);
+				md5_finish(&scalar, lane.job->digest);
+				lane.job = nullptr;
+				active--;
+			}
+			if (active == 0) break;
+		}
+
+		for (unsigned l = 0; l < L; l++)
+		{
+			const md5_lane& lane = lanes[l];
+			if (lane.job == nullptr) blocks[l] = idle;
+			else if (lane.blocks > 0) blocks[l] = lane.pos;
+			else blocks[l] = lane.tail + 64 * lane.tailDone;
+		}
+
+		step(state, blocks);
+
+		for (unsigned l = 0; l < L; l++)
+		{
+			md5_lane& lane = lanes[l];
+			if (lane.job == nullptr) continue;
+
+			if (lane.blocks > 0)
+			{
+				lane.pos += 64;
+				lane.blocks--;
+			}
+			else if (++lane.tailDone == lane.tailBlocks)
+			{
+				finish(l);
+				load(l);
+			}
+		}
+	}
+}
+
+#ifdef MD5_MULTI_X86
+static void md5_multi_sse2(md5_buffer* buffers, std::size_t count) { md5_lanes<4>(buffers, count, &md5_sse2::step); }
+static void md5_multi_avx2(md5_buffer* buffers, std::size_t count) { md5_lanes<8>(buffers, count, &md5_avx2::step); }
+static void md5_multi_avx512(md5_buffer* buffers, std::size_t count) { md5_lanes<16>(buffers, count, &md5_avx512::step); }
+#endif
+
+/**
+ *	An engine and whether it can run here
+ */
+struct md5_engine
+{
+	const char* name;
+	void (*run)(md5_buffer*, std::size_t);
+	bool (*supported)();
+};
+
+static const md5_engine engines[] =
+{
+#ifdef MD5_MULTI_X86
+	{ "avx512",	&md5_multi_avx512,	[] { return (bool) __builtin_cpu_supports("avx512f"); }	},
+	{ "avx2",	&md5_multi_avx2,	[] { return (bool) __builtin_cpu_supports("avx2"); }	},
+	{ "sse2",	&md5_multi_sse2,	[] { return (bool) __builtin_cpu_supports("sse2"); }	},
+#endif
+	{ "scalar",	&md5_scalar,		[] { return true; }	},
+};
+
+static const std::size_t engine_count = sizeof(engines) / sizeof(engines[0]);
+
+/**
+ *	The engine in use, the fastest supported one unless selected otherwise
+ */
+static std::atomic<const md5_engine*>& current_engine()
+{
+	static std::atomic<const md5_engine*> current([]
+	{
+		for (const md5_engine& engine : engines)
+		{
+			if (engine.supported()) return &engine;
+		}
+		return &engines[engine_count - 1];
+	}());
+	return current;
+}
+
+void md5_multi(md5_buffer* buffers, std::size_t count)
+{
+	current_engine().load()->run(buffers, count);
+}
+
+const char* md5_multi_engine()
+{
+	return current_engine().load()->name;
+}
+
+bool md5_multi_select(const char* name)
+{
+	for (const md5_engine& engine : engines)
+	{
+		if (strcmp(engine.name, name) == 0 && engine.supported())
+		{
+			current_engine() = &engine;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::size_t md5_multi_engine_count()
+{
+	return engine_count;
+}
+
+const char* md5_multi_engine_name(std::size_t index)
+{
+	return index < engine_count ? engines[index].name : nullptr;
+}
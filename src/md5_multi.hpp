@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+/**
+ *	One buffer of a batch, and the digest it gets
+ */
+struct md5_buffer
+{
+	const void* data;
+	std::size_t length;
+	uint8_t digest[16];
+};
+
+/*
+ * Multi-buffer MD5.
+ *
+ * MD5 can't be split within one stream, but independent streams can share
+ * the vector registers: the batch is hashed 4, 8 or 16 buffers at a time
+ * in the 32 bit lanes of SSE2, AVX2 or AVX-512 registers, whichever is the
+ * widest the CPU supports. A lane that finishes takes the next buffer of
+ * the batch, longest first, and the last few buffers are finished with
+ * the scalar code from md5.c when too few lanes would be busy.
+ */
+
+// Hashes every buffer of a batch
+void md5_multi(md5_buffer* buffers, std::size_t count);
+
+// The name of the engine in use: "avx512", "avx2", "sse2" or "scalar"
+const char* md5_multi_engine();
+
+// Switches to an engine by name, returns false if the CPU or the build lacks it
+bool md5_multi_select(const char* name);
+
+// The number of known engines, and the name of one, fastest first
+std::size_t md5_multi_engine_count();
+const char* md5_multi_engine_name(std::size_t index);
@@ -0,0 +1,133 @@
+#include "name_dictionary.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <cstring>
+
+#include "name_resolver.hpp"
+
+#define NAME_DICTIONARY_MAGIC "PKNM"
+#define NAME_DICTIONARY_VERSION 1
+
+bool name_dictionary::open(const std::string& path)
+{
+	close();
+	if (!file.open(path)) return false;
+
+	const char* data = file.data();
+	std::size_t size = file.size();
+
+	if (size < sizeof(name_dictionary_header))
+	{
+		close();
+		return false;
+	}
+
+	const name_dictionary_header* head = (const name_dictionary_header*) data;
+	uint64_t expected = sizeof(name_dictionary_header)
+		+ (uint64_t) head->count * 4
+		+ ((uint64_t) head->count + 1) * 4
+		+ head->blobSize;
+
+	if (memcmp(head->magic, NAME_DICTIONARY_MAGIC, 4) != 0 || head->version != NAME_DICTIONARY_VERSION || size != expected)
+	{
+		close();
+		return false;
+	}
+
+	const uint32_t* offs = (const uint32_t*) (data + sizeof(name_dictionary_header) + (std::size_t) head->count * 4);
+	if (offs[head->count] != head->blobSize)
+	{
+		close();
+		return false;
+	}
+
+	header = head;
+	crcs = (const uint32_t*) (data + sizeof(name_dictionary_header));
+	offsets = offs;
+	blob = (const char*) (offsets + head->count + 1);
+	return true;
+}
+
+void name_dictionary::close()
+{
+	file.close();
+	header = nullptr;
+	crcs = offsets = nullptr;
+	blob = nullptr;
+}
+
+int32_t name_dictionary::find(uint32_t crc) const
+{
+	if (header == nullptr) return -1;
+
+	const uint32_t* end = crcs + header->count;
+	const uint32_t* it = std::lower_bound(crcs, end, crc);
+	return (it != end && *it == crc) ? (int32_t) (it - crcs) : -1;
+}
+
+void name_dictionary::name(uint32_t index, const char*& name, uint32_t& length) const
+{
+	/* Offsets come from the file, so clamp them to the blob */
+	uint32_t start = std::min(offsets[index], header->blobSize);
+	uint32_t stop = std::min(std::max(offsets[index + 1], start), header->blobSize);
+	name = blob + start;
+	length = stop - start;
+}
+
+std::string name_dictionary::name(uint32_t index) const
+{
+	const char* str;
+	uint32_t length;
+	name(index, str, length);
+	return std::string(str, length);
+}
+
+bool name_dictionary::write(const std::string& path, const name_resolver& names)
+{
+	std::vector<uint32_t> order(names.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&names](uint32_t a, uint32_t b)
+	{
+		return names.crc(a) < names.crc(b);
+	});
+
+	/* The first path added for a CRC wins, like in the resolver */
+	std::vector<uint32_t> crcs;
+	std::vector<uint32_t> offsets;
+	std::string blob;
+	for (uint32_t i : order)
+	{
+		if (!crcs.empty() && crcs.back() == names.crc(i)) continue;
+		crcs.push_back(names.crc(i));
+		offsets.push_back(blob.size());
+		blob += names.path(i);
+	}
+	offsets.push_back(blob.size());
+
+	name_dictionary_header head;
+	memcpy(head.magic, NAME_DICTIONARY_MAGIC, 4);
+	head.version = NAME_DICTIONARY_VERSION;
+	head.count = crcs.size();
+	head.blobSize = blob.size();
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out.is_open()) return false;
+	out.write((const char*) &head, sizeof(head));
+	out.write((const char*) crcs.data(), crcs.size() * 4);
+	out.write((const char*) offsets.data(), offsets.size() * 4);
+	out.write(blob.data(), blob.size());
+	return out.good();
+}
+
+std::string name_dictionary::sidecar_path(const std::string& catalogPath)
+{
+	std::string::size_type len = catalogPath.size();
+	if (len >= 4 && catalogPath.compare(len - 4, 4, ".pki") == 0)
+	{
+		return catalogPath.substr(0, len - 4) + ".pkn";
+	}
+	return catalogPath + ".pkn";
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "mapped_file.hpp"
+
+class name_resolver;
+
+/**
+ *	The fixed size start of a name dictionary
+ */
+struct name_dictionary_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t blobSize;
+};
+
+/*
+ * A read-only CRC to path dictionary, mapped straight from a file.
+ *
+ * Layout: the header, the sorted CRCs, count + 1 offsets into the string
+ * blob and the blob with all paths back to back. The default location is
+ * next to the catalog (primary.pki -> primary.pkn), where the pack
+ * commands pick it up without reading a manifest.
+ */
+class name_dictionary {
+
+	mapped_file file;
+	const name_dictionary_header* header = nullptr;
+	const uint32_t* crcs = nullptr;
+	const uint32_t* offsets = nullptr;
+	const char* blob = nullptr;
+
+public:
+	// Maps a dictionary, returns false if it is missing or invalid
+	bool open(const std::string& path);
+
+	// Unmaps the dictionary
+	void close();
+
+	bool is_open() const { return header != nullptr; }
+	uint32_t size() const { return header ? header->count : 0; }
+	uint32_t crc(uint32_t index) const { return crcs[index]; }
+
+	// Returns the index of the entry for a CRC, or -1
+	int32_t find(uint32_t crc) const;
+
+	// Sets name and length to the path of an entry
+	void name(uint32_t index, const char*& name, uint32_t& length) const;
+
+	// Returns the path of an entry
+	std::string name(uint32_t index) const;
+
+	// Writes the paths of a built resolver as a dictionary, one per CRC
+	static bool write(const std::string& path, const name_resolver& names);
+
+	// The default dictionary path for a catalog
+	static std::string sidecar_path(const std::string& catalogPath);
+};
@@ -0,0 +1,106 @@
+#include "name_resolver.hpp"
+
+#include <algorithm>
+
+#include "crc.hpp"
+#include "parallel.hpp"
+
+using namespace assembly::manifest;
+
+#define RESOLVER_CHUNK 4096	// Paths hashed per work item
+
+void name_resolver::add(const std::string& path)
+{
+	names.push_back(path);
+}
+
+void name_resolver::add(const manifest_file& manifest)
+{
+	names.reserve(names.size() + manifest.files.size());
+	for (const manifest_entry& entry : manifest.files)
+	{
+		names.push_back(entry.path);
+	}
+}
+
+bool name_resolver::add_manifest(const std::string& path)
+{
+	manifest_file manifest;
+	if (read_from_file(path, manifest) != 0) return false;
+	add(manifest);
+	return true;
+}
+
+bool name_resolver::add_dictionary(const std::string& path)
+{
+	return dictionary.open(path);
+}
+
+void name_resolver::build(unsigned threads)
+{
+	std::size_t count = names.size();
+	crcs.resize(count);
+
+	std::size_t chunks = (count + RESOLVER_CHUNK - 1) / RESOLVER_CHUNK;
+	parallel::for_each(chunks, threads, [this, count](std::size_t chunk, unsigned)
+	{
+		std::size_t i = chunk * RESOLVER_CHUNK;
+		std::size_t end = std::min(i + RESOLVER_CHUNK, count);
+
+		for (; i + 4 <= end; i += 4)
+		{
+			const char* str[4];
+			std::size_t len[4];
+			for (int k = 0; k < 4; k++)
+			{
+				str[k] = names[i + k].c_str();
+				len[k] = names[i + k].size();
+			}
+			crc::path_x4(str, len, &crcs[i]);
+		}
+
+		for (; i < end; i++)
+		{
+			crcs[i] = crc::path(names[i].c_str(), names[i].size());
+		}
+	});
+
+	/* Keep the load factor at or below one half */
+	uint32_t bits = 1;
+	while (((uint64_t) 1 << bits) < 2 * (uint64_t) count) bits++;
+	shift = 32 - bits;
+
+	uint32_t mask = ((uint32_t) 1 << bits) - 1;
+	slots.assign((std::size_t) mask + 1, {0, 0});
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t pos = (crcs[i] * 0x9E3779B1u) >> shift;
+		while (slots[pos].name != 0 && slots[pos].crc != crcs[i]) pos = (pos + 1) & mask;
+		if (slots[pos].name != 0) continue;
+
+		slots[pos].crc = crcs[i];
+		slots[pos].name = i + 1;
+	}
+}
+
+int32_t name_resolver::find(uint32_t crc) const
+{
+	if (slots.empty()) return -1;
+
+	uint32_t mask = slots.size() - 1;
+	for (uint32_t pos = (crc * 0x9E3779B1u) >> shift; slots[pos].name != 0; pos = (pos + 1) & mask)
+	{
+		if (slots[pos].crc == crc) return slots[pos].name - 1;
+	}
+	return -1;
+}
+
+std::string name_resolver::name(uint32_t crc, const std::string& unknown) const
+{
+	int32_t index = find(crc);
+	if (index != -1) return names[index];
+
+	index = dictionary.find(crc);
+	return index == -1 ? unknown : dictionary.name(index);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <assembly/manifest.hpp>
+
+#include "name_dictionary.hpp"
+
+/*
+ * Resolves filename CRCs to client paths.
+ *
+ * The paths are collected from manifests first; build() then hashes them
+ * on all cores and puts them into an open-addressing table, so that every
+ * lookup afterwards takes constant time. If a CRC occurs more than once,
+ * the first path added wins.
+ *
+ * A name dictionary can back the table: CRCs that no added path has are
+ * looked up there, which needs neither a manifest nor any hashing.
+ */
+class name_resolver {
+
+	struct slot
+	{
+		uint32_t crc;
+		uint32_t name;	// Index of the name + 1, 0 for empty slots
+	};
+
+	std::vector<std::string> names;
+	std::vector<uint32_t> crcs;
+	std::vector<slot> slots;
+	uint32_t shift = 32;
+
+	name_dictionary dictionary;
+
+public:
+	// Adds a single path
+	void add(const std::string& path);
+
+	// Adds all paths of a manifest
+	void add(const assembly::manifest::manifest_file& manifest);
+
+	// Adds all paths of a manifest file, returns false if it can't be read
+	bool add_manifest(const std::string& path);
+
+	// Maps a name dictionary to fall back to, returns false if it is invalid
+	bool add_dictionary(const std::string& path);
+
+	// Computes the CRCs and the lookup table on `threads` threads (0 for all cores)
+	void build(unsigned threads = 0);
+
+	// The index of an added path for a CRC, or -1 if it is unknown
+	int32_t find(uint32_t crc) const;
+
+	// The path for a CRC from the paths or the dictionary, or `unknown`
+	std::string name(uint32_t crc, const std::string& unknown) const;
+
+	bool empty() const { return names.empty() && !dictionary.is_open(); }
+	std::size_t size() const { return names.size(); }
+	const std::string& path(std::size_t i) const { return names[i]; }
+	uint32_t crc(std::size_t i) const { return crcs[i]; }
+};
@@ -1,81 +1,53 @@
 #include "pack.hpp"
 
-#include <fstream>
-#include <algorithm>
-#include <iostream>
-#include <cstring>
+#include "crc.hpp"
+#include "pack_context.hpp"
 
-#include <assembly/catalog.hpp>
-#include <assembly/package.hpp>
-
-#define CRC_POLY 0x04C11DB7
-#define CRC_INIT 0xFFFFFFFF
-#define CRC_FXOR 0x00000000
-
-
-using namespace assembly::catalog;
-using namespace assembly::package;
+using namespace assembly::manifest;
 
 /**
- * The installation directory used
+ *	The context behind the free functions
  */
-std::string installDir = "./";
+static PackContext context;
 
-/**
- *	The catalog for the current directory
- */
-catalog_file catalog;
+PackContext& pack::GetDefaultContext()
+{
+	return context;
+}
 
 /**
- *	Updates a CRC value for the next byte
+ *	Generates a CRC-32 value for the specified filename
  */
-void updateCRC(uint32_t& crc, uint8_t b)
+uint32_t pack::GetCRCForFilename(const char* filename)
 {
-	crc ^= (uint32_t) (b << 24); /* Move byte to MSB */
-	for (int i = 0; i < 8; i++)
-	{
-		if ((crc & 0x80000000) == 0)
-		{
-			crc <<= 1;
-		}
-		else
-		{
-			crc = (uint32_t) ((crc << 1) ^ CRC_POLY);
-		}
-	}
+	return crc::path(filename);
 }
 
 /**
- * Calculates a variation of CRC-32 on a null-terminated string.
+ *	Generates the CRC-32 values for all files in a manifest
  */
-uint32_t calculateCRC(const char* path)
+void pack::GetCRCForFilenames(const std::vector<manifest_entry>& files, std::vector<uint32_t>& crcs)
 {
-	uint32_t crc = CRC_INIT;
-	/* Process the actual string */
-	for (int i = 0; path[i] != 0; i++)
-	{
-		/* Perform some cleanup on the input */
-		uint8_t b = (uint8_t) path[i];
-		if (b == '/') b = '\\';
-		if ('A' <= b && b <= 'Z') b += ('a' - 'A');
+	size_t count = files.size();
+	crcs.resize(count);
 
-		updateCRC(crc, b);
-	}
-	/* I have no clue why this was added */
-	for (int i = 0; i < 4; i++)
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
 	{
-		updateCRC(crc, 0);
+		const char* str[4];
+		size_t len[4];
+		for (int k = 0; k < 4; k++)
+		{
+			str[k] = files[i + k].path.c_str();
+			len[k] = files[i + k].path.size();
+		}
+		crc::path_x4(str, len, &crcs[i]);
 	}
-	crc ^= CRC_FXOR;
-	return crc;
-}
 
-/**
- *	Generates a CRC-32 value for the specified filename
- */
-uint32_t pack::GetCRCForFilename(const char* filename)
-{
-	return calculateCRC(filename);
+	for (; i < count; i++)
+	{
+		crcs[i] = crc::path(files[i].path.c_str(), files[i].path.size());
+	}
 }
 
 /**
@@ -83,10 +55,7 @@ uint32_t pack::GetCRCForFilename(const char* filename)
  */
 int32_t pack::SetInstallDir(char* strDirectory)
 {
-	installDir = std::string(strDirectory);
-
-	/* We don't know what this is supposed to return */
-	return 0;
+	return context.SetInstallDir(strDirectory);
 }
 
 /**
@@ -94,35 +63,12 @@ int32_t pack::SetInstallDir(char* strDirectory)
  */
 int32_t pack::GetPackIndex(uint32_t filenameCRC)
 {
-    catalog_ptr ptr = find_by_crc(&catalog, filenameCRC);
-    if (ptr.valid())
-    {
-        return ptr.pack_id();
-    }
-    return -1;
+	return context.GetPackIndex(filenameCRC);
 }
 
 int32_t pack::GetInfoForFile(uint32_t filenameCRC, int32_t packIndex, int32_t* bExists, int32_t* iUncompressedSize, char* uncompressedChecksum)
 {
-	std::string packName = catalog.pack_files.at(packIndex);
-	std::replace(packName.begin(), packName.end(), '\\', '/');
-
-    package_info packInfo;
-	read_from_file(installDir + packName, packInfo);
-
-	package_ptr ptr = find_by_crc(&packInfo, filenameCRC);
-	if (ptr.valid())
-	{
-		*bExists = 1;
-		*iUncompressedSize = ptr.uncompressedSize();
-		ptr.chkUncompressed(uncompressedChecksum);
-	}
-	else
-	{
-		*bExists = 0;
-	}
-
-	return 0;
+	return context.GetInfoForFile(filenameCRC, packIndex, bExists, iUncompressedSize, uncompressedChecksum);
 }
 
 int32_t pack::MoveFileToPack
@@ -133,45 +79,25 @@ int32_t pack::MoveFileToPack
 	int32_t fileIsCompressed
 )
 {
-	uint32_t crc = GetCRCForFilename(strManifestFilename);
-	int32_t packIndex = GetPackIndex(crc);
-	std::string packFile = catalog.pack_files.at(packIndex);
-
-	std::fstream infile(installDir + packFile);
-	if (infile.is_open())
-	{
-		infile.seekg(-8, infile.end);
-		uint32_t dataAddr, unknown;
-		infile.read((char*) dataAddr, 4);
-		infile.read((char*) unknown, 4);
-		infile.seekg(dataAddr, infile.beg);
-
-		package_info info;
-		read_from_stream(infile, info);
-
-		infile.seekp(dataAddr, infile.beg);
-		write_to_stream(infile, info);
-
-		infile.write((char*) dataAddr, 4);
-		infile.write((char*) unknown, 4);
-	}
-
-	return 0;
+	return context.MoveFileToPack(strFullFilename, strManifestFilename, iUncompressedSize, iCompressedSize, chkUncompressed, chkCompressed, fileIsCompressed);
 }
 
 int32_t pack::ReadPackCatalog(const char* strPackCatalogName)
 {
-	read_from_file(strPackCatalogName, catalog);
-	return catalog.pack_files.size();
+	return context.ReadPackCatalog(strPackCatalogName);
 }
 
 int32_t pack::GetPackName(int32_t index, char* buffer, int32_t bufferLenght)
 {
-	if (index < catalog.pack_files.size())
-	{
-		std::string name = catalog.pack_files.at(index);
-		strcpy(buffer, name.c_str());
-		return 0;
-	}
-	return 1;
+	return context.GetPackName(index, buffer, bufferLenght);
+}
+
+int32_t pack::SetInfoCacheSize(int32_t count)
+{
+	return context.SetInfoCacheSize(count);
+}
+
+int32_t pack::GetInfoCacheStats(uint64_t* hits, uint64_t* misses)
+{
+	return context.GetInfoCacheStats(hits, misses);
 }
@@ -1,10 +1,16 @@
 #pragma once
 #include <stdint.h>
+#include <vector>
+
+#include <assembly/manifest.hpp>
+
+class PackContext;
 
 namespace pack
 {
 	int32_t SetInstallDir(char* strDirectory);
 	uint32_t GetCRCForFilename(const char* strFilename);
+	void GetCRCForFilenames(const std::vector<assembly::manifest::manifest_entry>& files, std::vector<uint32_t>& crcs);
 	int32_t GetPackIndex(uint32_t filenameCRC);
 	int32_t GetInfoForFile(uint32_t filenameCRC, int32_t packIndex, int32_t* bExists, int32_t* iUncompressedSize, char* uncompressedChecksum);
 	int32_t MoveFileToPack(char* strFullFilename, char* strManifestFilename, int32_t iUncompressedSize, int32_t iCompressedSize, char* chkUncompressed, char* chkCompressed, int32_t fileIsCompressed);
@@ -12,4 +18,9 @@ namespace pack
 	int32_t ReadPackCatalog(const char* strPackCatalogName);
 
 	int32_t GetPackName(int32_t index, char* buffer, int32_t bufferLenght);
+
+	int32_t SetInfoCacheSize(int32_t count);
+	int32_t GetInfoCacheStats(uint64_t* hits, uint64_t* misses);
+
+	PackContext& GetDefaultContext();
 }
@@ -1,28 +1,37 @@
 #include "pack_cli.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <algorithm>
 #include <cstring>
+#include <climits>
 #include <unordered_map>
 #include <cmath>
+#include <chrono>
 #include <unistd.h>
 
-#include <assembly/catalog.hpp>
 #include <assembly/package.hpp>
 #include <assembly/manifest.hpp>
 #include <assembly/filesystem.hpp>
 #include <assembly/cli.hpp>
 
 #include "pack.hpp"
+#include "pack_recover.hpp"
+#include "catalog_view.hpp"
+#include "pack_index.hpp"
+#include "pack_extract.hpp"
+#include "pack_verify.hpp"
+#include "name_resolver.hpp"
+#include "name_dictionary.hpp"
 
-#include "sd0_stream.hpp"
 
 
 using namespace assembly::package;
 using namespace assembly::manifest;
-using namespace assembly::catalog;
 
+// The catalog loaded for the current subcommand, if any
+static std::string catalog_path;
 
 cli::opt_t pack_options[] =
 {
@@ -32,6 +41,7 @@ cli::opt_t pack_options[] =
 	{ "move-to",		&pack_move_to,		"Move a file into a pack file"						},
 	{ "read-catalog",	&pack_read_catalog,	"Load a pack catalog (*.pki)"						},
 	{ "name",			&pack_name,			"Get the path of a pack file within the client"		},
+	{ "cache",			&pack_cache,		"Show or resize the cache of pack file headers"		},
 
 	{ "list",			&pack_list,		 	"List all files with CRC in a pack file"			},
 	{ "tree",			&pack_tree,		 	"Show the binary tree within the pack file"			},
@@ -39,6 +49,10 @@ cli::opt_t pack_options[] =
 	{ "missing",		&pack_missing,	 	"Show files with CRC in manifest not in the catalog"},
 	{ "target",			&pack_target,	 	"Show all files supposed to be in a pack"			},
 	{ "full-extract",	&pack_full_extract,	"Extract a client"									},
+	{ "verify",			&pack_verify,		"Check all packed files against their checksums"	},
+	{ "recover-names",	&pack_recover_names,"Find names for unresolved CRCs from patterns"		},
+	{ "build-index",	&pack_build_index,	"Write the CRC to location index for a catalog"		},
+	{ "build-names",	&pack_build_names,	"Write the CRC to path dictionary for a catalog"	},
 
 	{ "console",		&console_pack,	 	"Provide an interactive interface"					},
 	{ "cli",			&console_pack,		0													},
@@ -75,13 +89,18 @@ int main_pack (int argc, char** argv)
 	if (catalog == 0 && strcmp(argv[optind], "cli") != 0
 					 && strcmp(argv[optind], "console") != 0
 					 && strcmp(argv[optind], "missing") != 0
-					 && strcmp(argv[optind], "all") != 0)
+					 && strcmp(argv[optind], "all") != 0
+					 && strcmp(argv[optind], "recover-names") != 0
+					 && strcmp(argv[optind], "build-index") != 0
+					 && strcmp(argv[optind], "build-names") != 0
+					 && strcmp(argv[optind], "verify") != 0)
 	{
 		catalog = "./versions/primary.pki";
 	}
 
 	if (catalog != 0)
 	{
+		catalog_path = catalog;
 		pack::ReadPackCatalog(catalog);
 	}
 
@@ -232,6 +251,32 @@ int pack_name (int argc, char** argv)
 	return 3;
 }
 
+int pack_cache(int argc, char** argv)
+{
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+			pack::SetInfoCacheSize(std::stol(optarg));
+			break;
+
+			default:
+			std::cerr << "Usage: pack cache [-s <size>]" << std::endl;
+			return 1;
+		}
+	}
+
+	uint64_t hits, misses;
+	int32_t count = pack::GetInfoCacheStats(&hits, &misses);
+	std::cout << std::setw(10) << "Cached: " << count << std::endl;
+	std::cout << std::setw(10) << "Hits: " << hits << std::endl;
+	std::cout << std::setw(10) << "Misses: " << misses << std::endl;
+	return 0;
+}
+
 int pack_read_catalog(int argc, char** argv)
 {
 	bool list = false;
@@ -283,34 +328,34 @@ bool sort(map_t a, map_t b)
 	return a.path < b.path;
 }
 
+/**
+ *	Loads the paths of a manifest (if any) and the dictionary of a catalog (if any)
+ */
+bool load_names(name_resolver& names, const char* manifest, const std::string& catalog)
+{
+	if (manifest != 0 && !names.add_manifest(manifest)) return false;
+	if (!catalog.empty()) names.add_dictionary(name_dictionary::sidecar_path(catalog));
+	names.build();
+	return true;
+}
+
 int pack_list (int argc, char** argv)
 {
-	if (argc > 2)
+	if (argc > 1)
 	{
 		package_info pack;
 		read_from_file(argv[1], pack);
 
-		manifest_file manifest;
-        read_from_file(argv[2], manifest);
+		name_resolver names;
+		if (!load_names(names, argc > 2 ? argv[2] : 0, catalog_path)) return 1;
 
+		const std::string unknown = "???";
 		std::vector<map_t> files;
+		files.reserve(pack.files.size());
 
 		for (std::vector<package_info_entry>::iterator it = pack.files.begin(); it != pack.files.end(); it++)
 		{
-			files.push_back({it->crc, "???", (it->bCompressed & 0xFF) != 0});
-		}
-
-		for (std::vector<manifest_entry>::iterator it = manifest.files.begin(); it != manifest.files.end(); it++)
-		{
-			uint32_t crc = pack::GetCRCForFilename(it->path.c_str());
-			for (std::vector<map_t>::iterator in = files.begin(); in != files.end(); in++)
-			{
-				if (in->crc == crc)
-				{
-					in->path = it->path;
-					break;
-				}
-			}
+			files.push_back({it->crc, names.name(it->crc, unknown), (it->bCompressed & 0xFF) != 0});
 		}
 
 		std::sort(files.begin(), files.end(), sort);
@@ -323,25 +368,25 @@ int pack_list (int argc, char** argv)
 	}
 	else
 	{
-		std::cout << "Usage: pack list <packfile> <manifest>" << std::endl;
+		std::cout << "Usage: pack list <packfile> [<manifest>]" << std::endl;
 		return 0;
 	}
 }
 
-void print(package_ptr ptr, int level, std::string prefix, bool top)
+void print(package_ptr ptr, const name_resolver& names, int level, std::string prefix, bool top)
 {
 	if (ptr.valid())
 	{
 		package_ptr l = ptr.left();
 		package_ptr r = ptr.right();
-		print(l, level + 1, prefix + "  ", true);
+		print(l, names, level + 1, prefix + "  ", true);
 		prefix.replace(level * 2, 2, top ? "\xe2\x94\x8c\xe2\x94\x80" : "\xe2\x94\x94\xe2\x94\x80");
 		std::cout << prefix +
 			(l.valid() ? (r.valid() ? "\xE2\x94\xBC" : "\xE2\x94\xB4" ) : (r.valid() ? "\xE2\x94\xAC" : "\xe2\x94\x80"))
-		+ "\xe2\x94\x84 " << ptr.crc() << std::endl;
+		+ "\xe2\x94\x84 " << ptr.crc() << " " << names.name(ptr.crc(), "") << std::endl;
 		// prefix.replace(level, 1, " ");
 		prefix.replace(level * 2, 6, top ? "| " : "  ");
-		print(r, level + 1, prefix + "| ", false);
+		print(r, names, level + 1, prefix + "| ", false);
 	}
 }
 
@@ -351,60 +396,73 @@ int pack_tree(int argc, char** argv)
 	{
 		package_info info;
 		read_from_file(argv[1], info);
-		print(package_ptr(&info), 0, "", false);
+
+		name_resolver names;
+		load_names(names, 0, catalog_path);
+		print(package_ptr(&info), names, 0, "", false);
 		return 0;
 	}
 	std::cout << "Usage: pack tree <packfile>" << std::endl;
 	return 1;
 }
 
-int32_t find_crc_index(catalog_file& file, uint32_t crc)
+int pack_all(int argc, char** argv)
 {
-	int size = file.files.size();
-	int index =  (size > 0) ? size / 2 : -1;
-
-	while (index != -1 && file.files.at(index).crc != crc)
+	if (argc > 1)
 	{
-		index = file.files.at(index).crc > crc ? file.files.at(index).left : file.files.at(index).right;
+		const char* manifest = argc > 2 ? argv[1] : 0;
+		const char* path = argc > 2 ? argv[2] : argv[1];
+
+		catalog_view catalog;
+		if (!catalog.open(path)) return 2;
+
+		name_resolver names;
+		if (!load_names(names, manifest, path)) return 1;
+
+		const std::string unknown = "???";
+		for (uint32_t i = 0; i < catalog.file_count(); i++)
+		{
+			uint32_t crc = catalog.entry(i).crc;
+			std::cout << std::setw(10) << crc << ": " << names.name(crc, unknown) << std::endl;
+		}
+		return 0;
 	}
 
-	return index;
+	std::cerr << "Usage: pack all [<manifest>] <catalog>" << std::endl;
+	return 1;
 }
 
-int pack_all(int argc, char** argv)
+int pack_missing(int argc, char** argv)
 {
 	if (argc > 2)
 	{
-		manifest_file manifest;
-		if (read_from_file(argv[1],manifest) != 0) return 1;
+		name_resolver names;
+		if (!names.add_manifest(argv[1])) return 1;
 
-		catalog_file catalog;
-		if (read_from_file(argv[2],catalog) != 0) return 2;
+		catalog_view catalog;
+		if (!catalog.open(argv[2])) return 2;
 
-		std::vector<std::string> names;
-		int count = catalog.files.size();
-		names.reserve(count);
+		names.build();
 
-		for (int i = 0; i < count; i++){
-			names.push_back("???");
+		/* Mark the manifest entries that the catalog knows */
+		std::vector<bool> packed(names.size(), false);
+		for (uint32_t i = 0; i < catalog.file_count(); i++)
+		{
+			int32_t index = names.find(catalog.entry(i).crc);
+			if (index != -1) packed[index] = true;
 		}
 
-		for (int i = 0; i < manifest.files.size(); i++)
+		/* Only files without a catalog entry need to be looked for on disk */
+		for (std::size_t i = 0; i < names.size(); i++)
 		{
-			std::string filename = manifest.files.at(i).path;
-			uint32_t crc = pack::GetCRCForFilename(filename.c_str());
+			if (packed[names.find(names.crc(i))]) continue;
 
-			int index = find_crc_index(catalog, crc);
-			if (index != -1)
+			const std::string& filename = names.path(i);
+			if (!fs::exists("./" + filename))
 			{
-				names.at(index) = filename;
+				std::cout << std::setw(10) << names.crc(i) << ": " << filename << std::endl;
 			}
 		}
-
-		for (int i = 0; i < count; i++)
-		{
-			std::cout << std::setw(10) << catalog.files.at(i).crc << ": " << names.at(i) << std::endl;
-		}
 		return 0;
 	}
 
@@ -412,218 +470,407 @@ int pack_all(int argc, char** argv)
 	return 1;
 }
 
-int pack_missing(int argc, char** argv)
+int pack_target(int argc, char** argv)
 {
 	if (argc > 2)
 	{
-		manifest_file manifest;
-		if (read_from_file(argv[1],manifest) != 0) return 1;
+		const char* manifest = argc > 3 ? argv[1] : 0;
+		const char* path = argc > 3 ? argv[2] : argv[1];
+		const char* pack = argc > 3 ? argv[3] : argv[2];
 
-		catalog_file catalog;
-		if (read_from_file(argv[2],catalog) != 0) return 2;
+		catalog_view catalog;
+		if (!catalog.open(path)) return 2;
 
-		std::vector<std::string> names;
+		int32_t index = catalog.pack_index(pack);
 
-		for (int i = 0; i < manifest.files.size(); i++)
-		{
-			std::string filename = manifest.files.at(i).path;
-			uint32_t crc = pack::GetCRCForFilename(filename.c_str());
+		std::cout << "Index: " << index << std::endl;
 
-			int index = find_crc_index(catalog, crc);
-			if (index == -1 && !fs::exists("./" + filename))
+		name_resolver names;
+		if (!load_names(names, manifest, path)) return 1;
+
+		const std::string unknown = "???";
+		for (uint32_t i = 0; i < catalog.file_count(); i++)
+		{
+			catalog_record e = catalog.entry(i);
+			if (e.pack == (uint32_t) index)
 			{
-				std::cout << std::setw(10) << crc << ": " << filename << std::endl;
+				std::cout << std::setw(10) << e.crc << ": " << names.name(e.crc, unknown) << std::endl;
 			}
 		}
+
 		return 0;
 	}
 
-	std::cerr << "Usage: pack tree <manifest> <catalog>" << std::endl;
-	return 1;
+	std::cerr << "Usage: pack target [<manifest>] <catalog> <packpath>" << std::endl;
 }
 
-int find_crc_idx(std::vector<uint32_t>& list, int min, int max, uint32_t crc)
+/**
+ *	Maps the sidecar index of a catalog if it is up to date, or builds it in memory
+ */
+bool load_pack_index(pack_index& index, const std::string& catalog, const std::string& base_dir)
 {
-	if (max < min) return -1;
-	int index = (max + min) / 2;
+	if (index.open(pack_index::sidecar_path(catalog)) && index.fresh(catalog, base_dir)) return true;
+	return index.build(catalog, base_dir);
+}
 
-	uint32_t fcrc = list.at(index);
+int pack_build_index(int argc, char** argv)
+{
+	const char* output = 0;
 
-	if (fcrc == crc) return index;
-	if (fcrc > crc) return find_crc_idx(list, min, index -1, crc);
-	return find_crc_idx(list, index + 1, max, crc);
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+			output = optarg;
+			break;
+		}
+	}
+
+	if (argc <= optind)
+	{
+		std::cerr << "Usage: pack build-index [-o <output>] <catalog> [<base-dir>]" << std::endl;
+		return 1;
+	}
+
+	std::string catalog(argv[optind]);
+	std::string base_dir = (argc > optind + 1) ? std::string(argv[optind + 1]) : "./";
+	std::string path = output ? std::string(output) : pack_index::sidecar_path(catalog);
+
+	pack_index index;
+	if (!index.build(catalog, base_dir))
+	{
+		std::cerr << "Could not read catalog '" << catalog << "'" << std::endl;
+		return 2;
+	}
+
+	if (!index.write(path))
+	{
+		std::cerr << "Could not write '" << path << "'" << std::endl;
+		return 3;
+	}
+
+	uint32_t present = 0;
+	for (uint32_t i = 0; i < index.size(); i++)
+	{
+		if (index.at(i).present()) present++;
+	}
+
+	std::cout << "Indexed " << index.size() << " files (" << present << " in packs) to " << path << std::endl;
+	return 0;
 }
 
-int pack_target(int argc, char** argv)
+int pack_build_names(int argc, char** argv)
 {
-	if (argc > 3)
+	const char* output = 0;
+	std::vector<std::string> manifests;
+	std::vector<std::string> lists;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "o:m:l:")) != -1)
 	{
-		manifest_file manifest;
-		if (read_from_file(argv[1],manifest) != 0) return 1;
+		switch (opt)
+		{
+			case 'o':
+			output = optarg;
+			break;
 
-		catalog_file catalog;
-		if (read_from_file(argv[2],catalog) != 0) return 2;
+			case 'm':
+			manifests.push_back(optarg);
+			break;
+
+			case 'l':
+			lists.push_back(optarg);
+			break;
+		}
+	}
 
-		int32_t index = catalog.get_pack_index(argv[3]);
+	if ((argc <= optind && output == 0) || (manifests.empty() && lists.empty()))
+	{
+		std::cerr << "Usage: pack build-names [-o <output>] [-m <manifest>]... [-l <list>]... [<catalog>]" << std::endl;
+		return 1;
+	}
 
-		std::cout << "Index: " << index << std::endl;
+	std::string path = output ? std::string(output) : name_dictionary::sidecar_path(argv[optind]);
 
-		std::vector<uint32_t> crcs;
-		std::vector<std::string> strings;
+	name_resolver names;
+	for (const std::string& manifest : manifests)
+	{
+		if (!names.add_manifest(manifest))
+		{
+			std::cerr << "Could not read manifest '" << manifest << "'" << std::endl;
+			return 2;
+		}
+	}
 
-		for (int i = 0; i < catalog.files.size(); i++)
+	/* Lists have one path per line, or "<crc>: <path>" as recover-names prints them */
+	for (const std::string& list : lists)
+	{
+		std::ifstream file(list);
+		if (!file.is_open())
 		{
-			catalog_entry e = catalog.files.at(i);
-			if (e.pack == index)
-			{
-				crcs.push_back(e.crc);
-				strings.push_back("???");
-			}
+			std::cerr << "Could not read list '" << list << "'" << std::endl;
+			return 2;
 		}
 
-		for (int i = 0; i < manifest.files.size(); i++)
+		std::string line;
+		while (std::getline(file, line))
 		{
-			std::string filename = manifest.files.at(i).path;
-			uint32_t crc = pack::GetCRCForFilename(filename.c_str());
-			int idx = find_crc_idx(crcs, 0, strings.size() - 1, crc);
-			if (idx != -1)
+			std::string::size_type sep = line.find(": ");
+			if (sep != std::string::npos && line.find_first_not_of(" 0123456789") == sep)
 			{
-				strings.at(idx) = filename;
+				line.erase(0, sep + 2);
 			}
+			if (!line.empty()) names.add(line);
 		}
+	}
 
-		for (int i = 0; i < crcs.size(); i++)
-		{
-			std::cout << std::setw(10) << crcs.at(i) << ": " << strings.at(i) << std::endl;
-		}
+	names.build();
 
-		return 0;
+	if (!name_dictionary::write(path, names))
+	{
+		std::cerr << "Could not write '" << path << "'" << std::endl;
+		return 3;
 	}
 
-	std::cerr << "Usage: pack target <manifest> <catalog> <packpath>" << std::endl;
+	name_dictionary dictionary;
+	dictionary.open(path);
+	std::cout << "Wrote " << dictionary.size() << " names to " << path << std::endl;
+	return 0;
 }
 
-void write_over(std::istream& in, std::ostream& out, int size)
+/**
+ *	Reads the argument of -j, returns false after a message if it is not a number
+ */
+bool parse_threads(const char* text, unsigned& threads)
 {
-	char buffer[1024];
-
-	while (size >= 1024)
+	char* end;
+	unsigned long value = strtoul(text, &end, 10);
+	if (*text == 0 || *end != 0 || value > UINT_MAX)
 	{
-		in.read((char*) buffer, 1024);
-		out.write((char*) buffer, 1024);
-		size -= 1024;
+		std::cerr << "Invalid thread count '" << text << "'" << std::endl;
+		return false;
 	}
+	threads = value;
+	return true;
+}
 
-	if (size > 0)
-	{
-		in.read((char*) buffer, size);
-		out.write((char*) buffer, size);
-	}
+/**
+ *	The throughput of a run in MB/s, or 0 if it took no measurable time
+ */
+double mb_per_second(uint64_t bytes, double seconds)
+{
+	return seconds > 0 ? bytes / 1048576.0 / seconds : 0;
 }
 
 int pack_full_extract(int argc, char** argv)
 {
-	if (argc > 2)
+	unsigned threads = 0;
+	bool verbose = false;
+	bool incremental = false;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "j:vi")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+			if (!parse_threads(optarg, threads)) return 1;
+			break;
+
+			case 'i':
+			incremental = true;
+			break;
+
+			case 'v':
+			verbose = true;
+			break;
+		}
+	}
+
+	if (argc > optind + 1)
 	{
 		std::string base_dir = "./";
 
-		if (argc > 3)
+		if (argc > optind + 2)
 		{
-			base_dir = std::string(argv[3]);
+			base_dir = std::string(argv[optind + 2]);
 		}
 
-		std::string out_dir = (argc > 4) ? std::string(argv[4]) : base_dir;
+		std::string out_dir = (argc > optind + 3) ? std::string(argv[optind + 3]) : base_dir;
 
 		manifest_file manifest;
-		if (read_from_file(argv[1],manifest) != 0) return 1;
-
-		catalog_file catalog;
-		if (read_from_file(argv[2],catalog) != 0) return 2;
+		if (read_from_file(argv[optind], manifest) != 0) return 1;
 
-		int packCount = catalog.pack_files.size();
+		catalog_view catalog;
+		if (!catalog.open(argv[optind + 1])) return 2;
 
-		std::vector<package_info> packFiles;
-		packFiles.reserve(packCount);
+		pack_index locations;
+		if (!load_pack_index(locations, argv[optind + 1], base_dir)) return 2;
 
-		for (int i = 0; i < packCount; i++)
+		pack_extractor extractor(catalog, locations, base_dir, out_dir);
+		extractor.verbose = verbose;
+		extractor.incremental = incremental;
+		for (const manifest_entry& entry : manifest.files)
 		{
-			 packFiles.push_back(package_info());
-			 std::string path = catalog.pack_files.at(i);
-			 std::replace(path.begin(), path.end(), '\\', '/');
+			extractor.add(entry.path);
+		}
+
+		extract_stats stats = extractor.run(threads);
 
-			 read_from_file(base_dir + path, packFiles.at(i));
-			 std::cout << packFiles.at(i).files.size() << std::endl;
+		std::cout << std::setw(12) << "Files: " << stats.files << std::endl;
+		if (incremental)
+		{
+			std::cout << std::setw(12) << "Up to date: " << stats.upToDate << std::endl;
+			std::cout << std::setw(12) << "Checked: " << (stats.bytesHashed >> 20) << " MiB" << std::endl;
 		}
+		std::cout << std::setw(12) << "Not packed: " << extractor.missing() << std::endl;
+		std::cout << std::setw(12) << "Failed: " << stats.failed << std::endl;
+		std::cout << std::setw(12) << "Read: " << (stats.bytesIn >> 20) << " MiB" << std::endl;
+		std::cout << std::setw(12) << "Written: " << (stats.bytesOut >> 20) << " MiB in " << stats.seconds << "s ("
+		          << mb_per_second(stats.bytesOut, stats.seconds) << " MB/s)" << std::endl;
+
+		return stats.failed > 0 ? 3 : 0;
+	}
+
+	std::cerr << "Usage: pack full-extract [-j <threads>] [-v] [-i] <manifest> <catalog> [<base-dir> [<out-dir>]]" << std::endl;
+	return 1;
+}
+
+int pack_verify(int argc, char** argv)
+{
+	unsigned threads = 0;
+	bool verbose = false;
+	const char* manifest = 0;
 
-		for (int i = 0; i < manifest.files.size(); i++)
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "j:vm:")) != -1)
+	{
+		switch (opt)
 		{
-			std::string path = manifest.files.at(i).path;
-			std::cout << "Extracting: " << path << std::endl;
-			uint32_t crc = pack::GetCRCForFilename(path.c_str());
+			case 'j':
+			if (!parse_threads(optarg, threads)) return 1;
+			break;
 
-			catalog_ptr ptr = find_by_crc(&catalog, crc);
-			if (!ptr.valid()) continue;
+			case 'v':
+			verbose = true;
+			break;
 
-			int id = ptr.pack_id();
+			case 'm':
+			manifest = optarg;
+			break;
+		}
+	}
 
-			package_ptr itr = find_by_crc(&(packFiles.at(id)), crc);
-			if (!itr.valid()) continue;
+	if (argc <= optind)
+	{
+		std::cerr << "Usage: pack verify [-j <threads>] [-v] [-m <manifest>] <catalog> [<base-dir>]" << std::endl;
+		return 1;
+	}
 
-			std::replace(path.begin(), path.end(), '\\', '/');
-			std::string out = out_dir + path;
-			fs::ensure_dir_exists(out);
+	std::string catalog_file(argv[optind]);
+	std::string base_dir = (argc > optind + 1) ? std::string(argv[optind + 1]) : "./";
 
-			std::ofstream ofile(out);
+	catalog_view catalog;
+	if (!catalog.open(catalog_file)) return 2;
 
-			if (ofile.is_open())
-			{
-				std::string pth = catalog.pack_files.at(ptr.pack_id());
-				std::replace(pth.begin(),pth.end(), '\\', '/');
-				std::ifstream ifile(base_dir + pth);
+	pack_index locations;
+	if (!load_pack_index(locations, catalog_file, base_dir)) return 2;
 
-				if (ifile.is_open())
-				{
-					ifile.seekg(itr.dataAddress());
-
-					if (itr.compressed())
-					{
-						sd0_istreambuf<1024> ibuf(&ifile);
-						std::istream istrm(&ibuf);
-						write_over(istrm, ofile, itr.compressedSize());
-					}
-					else
-					{
-						int size = itr.uncompressedSize();
-						write_over(ifile, ofile, itr.uncompressedSize());
-					}
-
-					ifile.close();
-				}
+	pack_verifier verifier(catalog, locations, base_dir);
+	verifier.verbose = verbose;
+	verify_stats stats = verifier.run(threads);
 
-				ofile.close();
-			}
+	if (!verifier.failures().empty())
+	{
+		/* Without the manifest, the failures are still worth listing by CRC */
+		name_resolver names;
+		if (!load_names(names, manifest, catalog_file))
+		{
+			std::cerr << "Could not read manifest '" << manifest << "', names are left out" << std::endl;
+			load_names(names, 0, catalog_file);
 		}
 
-		return 0;
+		for (const verify_failure& failure : verifier.failures())
+		{
+			std::cout << std::setw(10) << failure.crc << " " << names.name(failure.crc, "???") << ": " << failure.reason << std::endl;
+		}
 	}
 
-	std::cerr << "Usage: pack full-extract <manifest> <catalog> [<base-dir>]" << std::endl;
-	return 1;
+	std::cout << std::setw(12) << "Files: " << stats.files << std::endl;
+	std::cout << std::setw(12) << "OK: " << stats.ok << std::endl;
+	std::cout << std::setw(12) << "Failed: " << verifier.failures().size() << std::endl;
+	std::cout << std::setw(12) << "Not packed: " << stats.notPacked << std::endl;
+	std::cout << std::setw(12) << "Read: " << (stats.bytesIn >> 20) << " MiB" << std::endl;
+	std::cout << std::setw(12) << "Checked: " << (stats.bytesOut >> 20) << " MiB in " << stats.seconds << "s ("
+	          << mb_per_second(stats.bytesOut, stats.seconds) << " MB/s)" << std::endl;
+
+	return verifier.failures().empty() ? 0 : 3;
 }
 
 int main_catalog (int argc, char** argv)
 {
 	if (argc > 2)
 	{
-		catalog_file catalog;
-		read_from_file(argv[1],catalog);
-		catalog_ptr ptr = find_by_crc(&catalog, pack::GetCRCForFilename(argv[2]));
-		if (ptr.valid())
+		catalog_view catalog;
+		catalog.open(argv[1]);
+
+		/* A number is a CRC, its name comes from the dictionary */
+		std::string filename = argv[2];
+		char* end;
+		uint32_t crc = strtoul(argv[2], &end, 0);
+		if (*end == 0)
 		{
-			std::cout << std::setw(20) << "Filename: " << argv[2] << std::endl;
-			std::cout << std::setw(20) << "CRC: " << ptr.crc() << std::endl;
-			std::cout << std::setw(20) << "Pack File: " << ptr.pack() << std::endl;
-			std::cout << std::setw(20) << "Data: " << ptr.data() << std::endl;
+			name_resolver names;
+			load_names(names, 0, argv[1]);
+			filename = names.name(crc, "???");
+		}
+		else
+		{
+			crc = pack::GetCRCForFilename(argv[2]);
+		}
+
+		pack_index locations;
+		std::string sidecar = pack_index::sidecar_path(argv[1]);
+		const pack_location* loc = (locations.open(sidecar) && locations.fresh(argv[1], "./")) ? locations.find(crc) : nullptr;
+
+		int32_t index = loc ? -1 : catalog.find(crc);
+		if (loc != nullptr)
+		{
+			char hex[32];
+			std::cout << std::setw(20) << "Filename: " << filename << std::endl;
+			std::cout << std::setw(20) << "CRC: " << loc->crc << std::endl;
+			std::cout << std::setw(20) << "Pack File: " << catalog.pack_name(loc->pack) << std::endl;
+			if (loc->present())
+			{
+				md5_to_hex(loc->chkUncompressed, hex);
+				std::cout << std::setw(20) << "Data Address: " << loc->dataAddress << std::endl;
+				std::cout << std::setw(20) << "Size: " << loc->uncompressedSize << std::endl;
+				std::cout << std::setw(20) << "Checksum: " << std::string(hex, 32) << std::endl;
+				if (loc->compressed())
+				{
+					md5_to_hex(loc->chkCompressed, hex);
+					std::cout << std::setw(20) << "Compressed Size: " << loc->compressedSize << std::endl;
+					std::cout << std::setw(20) << "Compressed Check: " << std::string(hex, 32) << std::endl;
+				}
+			}
+			else
+			{
+				std::cout << std::setw(20) << "Data: " << "missing from the pack" << std::endl;
+			}
+		}
+		else if (index != -1)
+		{
+			catalog_record entry = catalog.entry(index);
+			std::cout << std::setw(20) << "Filename: " << filename << std::endl;
+			std::cout << std::setw(20) << "CRC: " << entry.crc << std::endl;
+			std::cout << std::setw(20) << "Pack File: " << catalog.pack_name(entry.pack) << std::endl;
+			std::cout << std::setw(20) << "Data: " << entry.data << std::endl;
 		}
 		else
 		{
@@ -633,7 +880,97 @@ int main_catalog (int argc, char** argv)
 	}
 	else
 	{
-		std::cout << "Usage: catalog <catalog> <path>" << std::endl;
+		std::cout << "Usage: catalog <catalog> <path|crc>" << std::endl;
 		return 1;
 	}
 }
+
+int pack_recover_names(int argc, char** argv)
+{
+	unsigned threads = 0;
+	std::vector<std::string> manifests;
+
+	char opt = 0;
+	optind = 1;
+	while ((opt = getopt(argc, argv, "j:m:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+			if (!parse_threads(optarg, threads)) return 1;
+			break;
+
+			case 'm':
+			manifests.push_back(optarg);
+			break;
+		}
+	}
+
+	if (argc <= optind + 1)
+	{
+		std::cerr << "Usage: pack recover-names [-j <threads>] [-m <manifest>]... <catalog> <pattern>..." << std::endl;
+		return 1;
+	}
+
+	catalog_view catalog;
+	if (!catalog.open(argv[optind])) return 2;
+
+	/* Everything any of the manifests resolves is not interesting */
+	std::vector<uint32_t> known;
+	for (const std::string& path : manifests)
+	{
+		manifest_file manifest;
+		if (read_from_file(path, manifest) != 0) return 1;
+
+		std::vector<uint32_t> crcs;
+		pack::GetCRCForFilenames(manifest.files, crcs);
+		known.insert(known.end(), crcs.begin(), crcs.end());
+	}
+	std::sort(known.begin(), known.end());
+
+	std::vector<uint32_t> unresolved;
+	for (uint32_t i = 0; i < catalog.file_count(); i++)
+	{
+		uint32_t crc = catalog.entry(i).crc;
+		if (!std::binary_search(known.begin(), known.end(), crc))
+		{
+			unresolved.push_back(crc);
+		}
+	}
+
+	recover::crc_set targets(unresolved);
+	std::cerr << "Unresolved: " << targets.size() << std::endl;
+
+	std::vector<recover::match> matches;
+	for (int i = optind + 1; i < argc; i++)
+	{
+		recover::pattern pattern;
+		std::string error;
+		if (!recover::parse(argv[i], pattern, error))
+		{
+			std::cerr << "Invalid pattern '" << argv[i] << "': " << error << std::endl;
+			return 3;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t found = matches.size();
+		recover::search(pattern, targets, threads, matches);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cerr << argv[i] << ": " << pattern.count() << " candidates, "
+		          << (matches.size() - found) << " matches in " << seconds << "s ("
+		          << (seconds > 0 ? pattern.count() / seconds / 1e6 : 0) << " M/s)" << std::endl;
+	}
+
+	std::sort(matches.begin(), matches.end(), [](const recover::match& a, const recover::match& b)
+	{
+		return a.crc < b.crc || (a.crc == b.crc && a.path < b.path);
+	});
+
+	for (const recover::match& match : matches)
+	{
+		std::cout << std::setw(10) << match.crc << ": " << match.path << std::endl;
+	}
+
+	return 0;
+}
@@ -11,6 +11,7 @@ int pack_file_info(int argc, char** argv);
 int pack_move_to(int argc, char** argv);
 int pack_read_catalog(int argc, char** argv);
 int pack_name(int argc, char** argv);
+int pack_cache(int argc, char** argv);
 
 int pack_list(int argc, char** argv);
 int pack_tree(int argc, char** argv);
@@ -18,5 +19,9 @@ int pack_all(int argc, char** argv);
 int pack_missing(int argc, char** argv);
 int pack_target(int argc, char** argv);
 int pack_full_extract(int argc, char** argv);
+int pack_verify(int argc, char** argv);
+int pack_recover_names(int argc, char** argv);
+int pack_build_index(int argc, char** argv);
+int pack_build_names(int argc, char** argv);
 
 int main_catalog(int argc, char** argv);
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "pack_context.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+#include "crc.hpp"
+
+using namespace assembly::package;
+
+PackContext::PackContext(const std::string& installDir) : installDir(installDir) {}
+
+int32_t PackContext::SetInstallDir(const std::string& directory)
+{
+	installDir = directory;
+	ClearCache();
+	CheckLocations();
+
+	/* We don't know what this is supposed to return */
+	return 0;
+}
+
+int32_t PackContext::ReadPackCatalog(const std::string& catalogPath)
+{
+	catalog.open(catalogPath);
+	ClearCache();
+
+	if (!locations.open(pack_index::sidecar_path(catalogPath)) || !locations.fresh(catalogPath, installDir))
+	{
+		locations.close();
+	}
+	return catalog.pack_count();
+}
+
+uint32_t PackContext::GetCRCForFilename(const char* filename)
+{
+	return crc::path(filename);
+}
+
+int32_t PackContext::GetPackIndex(uint32_t filenameCRC) const
+{
+	const pack_location* loc = locations.find(filenameCRC);
+	if (loc != nullptr)
+	{
+		return loc->pack;
+	}
+
+	int32_t index = locations.is_open() ? -1 : catalog.find(filenameCRC);
+	if (index != -1)
+	{
+		return catalog.entry(index).pack;
+	}
+	return -1;
+}
+
+int32_t PackContext::GetInfoForFile(uint32_t filenameCRC, int32_t packIndex, int32_t* bExists, int32_t* iUncompressedSize, char* uncompressedChecksum)
+{
+	/* The index only knows the pack the catalog assigns a file to, others are parsed */
+	const pack_location* loc = locations.find(filenameCRC);
+	if (loc != nullptr && loc->pack == (uint32_t) packIndex)
+	{
+		if (loc->present())
+		{
+			*bExists = 1;
+			*iUncompressedSize = loc->uncompressedSize;
+			md5_to_hex(loc->chkUncompressed, uncompressedChecksum);
+		}
+		else
+		{
+			*bExists = 0;
+		}
+		return 0;
+	}
+
+	std::shared_ptr<package_info> packInfo = GetPackInfo(packIndex);
+	if (!packInfo)
+	{
+		*bExists = 0;
+		return 0;
+	}
+
+	package_ptr ptr = find_by_crc(packInfo.get(), filenameCRC);
+	if (ptr.valid())
+	{
+		*bExists = 1;
+		*iUncompressedSize = ptr.uncompressedSize();
+		ptr.chkUncompressed(uncompressedChecksum);
+	}
+	else
+	{
+		*bExists = 0;
+	}
+
+	return 0;
+}
+
+int32_t PackContext::MoveFileToPack
+(
+	char* strFullFilename, char* strManifestFilename,
+	int32_t iUncompressedSize, int32_t iCompressedSize,
+	char* chkUncompressed, char* chkCompressed,
+	int32_t fileIsCompressed
+)
+{
+	uint32_t crc = GetCRCForFilename(strManifestFilename);
+	int32_t packIndex = GetPackIndex(crc);
+	if (packIndex < 0) return 1;
+
+	std::fstream infile(GetPackPath(packIndex));
+	if (infile.is_open())
+	{
+		infile.seekg(-8, infile.end);
+		uint32_t dataAddr, unknown;
+		infile.read((char*) &dataAddr, 4);
+		infile.read((char*) &unknown, 4);
+		infile.seekg(dataAddr, infile.beg);
+
+		package_info info;
+		read_from_stream(infile, info);
+
+		infile.seekp(dataAddr, infile.beg);
+		write_to_stream(infile, info);
+
+		infile.write((char*) &dataAddr, 4);
+		infile.write((char*) &unknown, 4);
+	}
+
+	return 0;
+}
+
+int32_t PackContext::GetPackName(int32_t index, char* buffer, int32_t bufferLength) const
+{
+	const char* name;
+	uint32_t length;
+	if (index >= 0 && catalog.pack_name(index, name, length) && (int32_t) length < bufferLength)
+	{
+		memcpy(buffer, name, length);
+		buffer[length] = 0;
+		return 0;
+	}
+	return 1;
+}
+
+std::string PackContext::GetPackPath(int32_t index) const
+{
+	if (index < 0 || (uint32_t) index >= catalog.pack_count()) return std::string();
+
+	std::string packName = catalog.pack_name(index);
+	std::replace(packName.begin(), packName.end(), '\\', '/');
+	return installDir + packName;
+}
+
+std::shared_ptr<package_info> PackContext::GetPackInfo(int32_t packIndex)
+{
+	std::string path = GetPackPath(packIndex);
+	if (path.empty()) return nullptr;
+
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+
+		auto found = cacheIndex.find(packIndex);
+		if (found != cacheIndex.end())
+		{
+			std::list<CachedPack>::iterator it = found->second;
+			if (it->size == st.st_size && it->mtime.tv_sec == st.st_mtim.tv_sec && it->mtime.tv_nsec == st.st_mtim.tv_nsec)
+			{
+				cacheHits++;
+				cache.splice(cache.begin(), cache, it);
+				return it->info;
+			}
+
+			cache.erase(it);
+			cacheIndex.erase(found);
+		}
+
+		cacheMisses++;
+	}
+
+	/* Parse without holding the lock, so that hits on other packs go on */
+	std::shared_ptr<package_info> info = std::make_shared<package_info>();
+	if (read_from_file(path, *info) != 0) return nullptr;
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (cacheCapacity > 0 && cacheIndex.find(packIndex) == cacheIndex.end())
+	{
+		cache.push_front({packIndex, st.st_mtim, st.st_size, info});
+		cacheIndex[packIndex] = cache.begin();
+		TrimCache();
+	}
+
+	return info;
+}
+
+int32_t PackContext::SetInfoCacheSize(int32_t count)
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	cacheCapacity = count > 0 ? count : 0;
+	TrimCache();
+	return 0;
+}
+
+int32_t PackContext::GetInfoCacheStats(uint64_t* hits, uint64_t* misses) const
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	*hits = cacheHits;
+	*misses = cacheMisses;
+	return cache.size();
+}
+
+/**
+ *	Drops the location index if any pack in the install directory differs from it
+ */
+void PackContext::CheckLocations()
+{
+	for (uint32_t p = 0; locations.is_open() && p < catalog.pack_count(); p++)
+	{
+		if (!locations.pack_fresh(p, GetPackPath(p))) locations.close();
+	}
+}
+
+/**
+ *	Drops all cached pack headers
+ */
+void PackContext::ClearCache()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	cache.clear();
+	cacheIndex.clear();
+}
+
+/**
+ *	Evicts the least recently used headers, the lock must be held
+ */
+void PackContext::TrimCache()
+{
+	while (cache.size() > cacheCapacity)
+	{
+		cacheIndex.erase(cache.back().packIndex);
+		cache.pop_back();
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include <assembly/package.hpp>
+
+#include "catalog_view.hpp"
+#include "pack_index.hpp"
+
+/*
+ * Everything needed to look up files in one client installation: the
+ * install directory, its catalog, the location index (if there is an up
+ * to date sidecar) and the cache of parsed pack headers. The index is
+ * checked against the catalog and the packs when it is loaded, and a
+ * pack that changes after that is not noticed by it until the catalog is
+ * read again.
+ *
+ * Setting it up (SetInstallDir, ReadPackCatalog) must not overlap with
+ * other calls. After that, all lookups may be called from many threads
+ * at once. Several contexts can serve different clients side by side.
+ */
+class PackContext
+{
+	/**
+	 *	A parsed pack header, along with the state of the file it was read from
+	 */
+	struct CachedPack
+	{
+		int32_t packIndex;
+		struct timespec mtime;
+		off_t size;
+		std::shared_ptr<assembly::package::package_info> info;
+	};
+
+	std::string installDir;
+	catalog_view catalog;
+	pack_index locations;
+
+	// The parsed pack headers, most recently used first
+	mutable std::mutex cacheMutex;
+	std::list<CachedPack> cache;
+	std::unordered_map<int32_t, std::list<CachedPack>::iterator> cacheIndex;
+	size_t cacheCapacity = 16;
+	uint64_t cacheHits = 0;
+	uint64_t cacheMisses = 0;
+
+	void ClearCache();
+	void TrimCache();
+	void CheckLocations();
+
+public:
+	PackContext(const std::string& installDir = "./");
+
+	PackContext(const PackContext&) = delete;
+	PackContext& operator=(const PackContext&) = delete;
+
+	// Sets the installation directory, which pack paths are relative to
+	int32_t SetInstallDir(const std::string& directory);
+
+	// Loads a catalog (*.pki), and its location index if it is up to date
+	int32_t ReadPackCatalog(const std::string& catalogPath);
+
+	// Generates a CRC-32 value for the specified filename
+	static uint32_t GetCRCForFilename(const char* filename);
+
+	// Gets the index of the pack file, which the file in this CRC sits in
+	int32_t GetPackIndex(uint32_t filenameCRC) const;
+
+	// Checks whether the file is in the pack, and gets its size and checksum
+	int32_t GetInfoForFile(uint32_t filenameCRC, int32_t packIndex, int32_t* bExists, int32_t* iUncompressedSize, char* uncompressedChecksum);
+
+	// Moves a file into its pack
+	int32_t MoveFileToPack(char* strFullFilename, char* strManifestFilename, int32_t iUncompressedSize, int32_t iCompressedSize, char* chkUncompressed, char* chkCompressed, int32_t fileIsCompressed);
+
+	// Copies the path of a pack within the client into the buffer
+	int32_t GetPackName(int32_t index, char* buffer, int32_t bufferLength) const;
+
+	// Returns the path of a pack on disk, or an empty string
+	std::string GetPackPath(int32_t index) const;
+
+	// Returns the parsed header of a pack, or null if there is no such file or it cannot be parsed
+	std::shared_ptr<assembly::package::package_info> GetPackInfo(int32_t packIndex);
+
+	// Limits the number of cached pack headers
+	int32_t SetInfoCacheSize(int32_t count);
+
+	// Gets the hit/miss counters, returns the number of cached headers
+	int32_t GetInfoCacheStats(uint64_t* hits, uint64_t* misses) const;
+
+	const catalog_view& Catalog() const { return catalog; }
+	const pack_index& Locations() const { return locations; }
+	const std::string& InstallDir() const { return installDir; }
+};
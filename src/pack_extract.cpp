@@ -0,0 +1,308 @@
+#include "pack_extract.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#include <assembly/filesystem.hpp>
+
+#include "crc.hpp"
+#include "parallel.hpp"
+#include "sd0_codec.hpp"
+#include "pack_reader.hpp"
+#include "md5.h"
+
+#define EXTRACT_JOURNAL ".paradox-extract.journal"
+#define HASH_BUFFER_SIZE 262144
+#define SPLIT_SIZE (4 * SD0_BLOCK_SIZE)	// Files from this size on are inflated on the idle workers too
+
+/**
+ *	A file that was completely written (or found up to date) by an
+ *	extraction, along with the state of the output file at that time and
+ *	the checksum it was written for
+ */
+struct journal_record
+{
+	uint32_t crc;
+	uint32_t size;
+	int64_t mtime;
+	uint8_t md5[16];
+};
+
+static int64_t mtime_of(const struct stat& st)
+{
+	return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/**
+ *	Computes the MD5 of a file, returns false if it can't be read
+ */
+static bool md5_file(const std::string& path, md5_byte_t digest[16], std::vector<char>& buffer)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) return false;
+
+	buffer.resize(HASH_BUFFER_SIZE);
+
+	md5_state_t state;
+	md5_init(&state);
+	while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0)
+	{
+		md5_append(&state, (const md5_byte_t*) buffer.data(), file.gcount());
+	}
+	md5_finish(&state, digest);
+	return true;
+}
+
+pack_extractor::pack_extractor(const catalog_view& catalog, const pack_index& locations, const std::string& baseDir, const std::string& outDir)
+	: catalog(catalog), locations(locations), baseDir(baseDir), outDir(outDir), packs(catalog.pack_count())
+{
+}
+
+std::string pack_extractor::journal_path() const
+{
+	return outDir + EXTRACT_JOURNAL;
+}
+
+bool pack_extractor::add(const std::string& path)
+{
+	const pack_location* loc = locations.find(crc::path(path.c_str(), path.size()));
+	if (loc == nullptr || !loc->present() || loc->pack >= packs.size())
+	{
+		skipped++;
+		return false;
+	}
+
+	std::string out = path;
+	std::replace(out.begin(), out.end(), '\\', '/');
+	packs[loc->pack].push_back({loc, outDir + out});
+	return true;
+}
+
+extract_stats pack_extractor::run(unsigned threads)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	/* Read each pack front to back, and start with the largest packs */
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> weight(packs.size(), 0);
+	for (uint32_t p = 0; p < packs.size(); p++)
+	{
+		if (packs[p].empty()) continue;
+
+		std::sort(packs[p].begin(), packs[p].end(), [](const job& a, const job& b)
+		{
+			return a.loc->dataAddress < b.loc->dataAddress;
+		});
+
+		for (const job& j : packs[p])
+		{
+			weight[p] += j.loc->compressed() ? j.loc->compressedSize : j.loc->uncompressedSize;
+		}
+		order.push_back(p);
+	}
+	std::sort(order.begin(), order.end(), [&weight](uint32_t a, uint32_t b) { return weight[a] > weight[b]; });
+
+	/* Creating directories is not safe to do concurrently */
+	std::set<std::string> dirs;
+	for (const std::vector<job>& jobs : packs)
+	{
+		for (const job& j : jobs)
+		{
+			if (dirs.insert(j.path.substr(0, j.path.find_last_of('/') + 1)).second)
+			{
+				fs::ensure_dir_exists(j.path);
+			}
+		}
+	}
+
+	/* Files finished by an interrupted run, keyed by CRC */
+	std::unordered_map<uint32_t, journal_record> finished;
+	FILE* journal = nullptr;
+	if (incremental)
+	{
+		journal = fopen(journal_path().c_str(), "a+b");
+		if (journal != nullptr)
+		{
+			journal_record record;
+			rewind(journal);
+			while (fread(&record, sizeof(record), 1, journal) == 1)
+			{
+				finished[record.crc] = record;
+			}
+		}
+	}
+
+	std::atomic<uint64_t> files(0), upToDate(0), failed(0), bytesIn(0), bytesOut(0), bytesHashed(0);
+	std::mutex logMutex;
+	std::mutex journalMutex;
+
+	std::vector<journal_record> recorded;
+
+	auto record = [&](const pack_location* loc, const struct stat& st)
+	{
+		if (journal == nullptr) return;
+		journal_record entry = {loc->crc, loc->uncompressedSize, mtime_of(st), {0}};
+		memcpy(entry.md5, loc->chkUncompressed, 16);
+		std::lock_guard<std::mutex> lock(journalMutex);
+		fwrite(&entry, sizeof(entry), 1, journal);
+		fflush(journal);
+		recorded.push_back(entry);
+	};
+
+	if (threads == 0) threads = parallel::default_threads();
+
+	/* Workers without a pack left lend their thread to the large files of the others */
+	std::atomic<std::size_t> packsDone(0);
+	std::atomic<unsigned> lent(0);
+
+	auto borrow = [&]() -> unsigned
+	{
+		std::size_t running = std::min<std::size_t>(threads, order.size() - packsDone);
+		unsigned idle = threads - running;
+		unsigned current = lent;
+		while (current < idle)
+		{
+			if (lent.compare_exchange_weak(current, idle)) return idle - current;
+		}
+		return 0;
+	};
+
+	parallel::for_each(order.size(), threads, [&](std::size_t i, unsigned)
+	{
+		uint32_t p = order[i];
+		std::string packPath = catalog.pack_name(p);
+		std::replace(packPath.begin(), packPath.end(), '\\', '/');
+
+		pack_reader pack;
+		if (!pack.open(baseDir + packPath))
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cerr << "Could not open pack '" << baseDir + packPath << "'" << std::endl;
+			failed += packs[p].size();
+			packsDone++;
+			return;
+		}
+
+		pack.advise(MADV_SEQUENTIAL);
+		std::vector<char> data;
+
+		for (const job& j : packs[p])
+		{
+			const pack_location* loc = j.loc;
+
+			struct stat st;
+			if (incremental && stat(j.path.c_str(), &st) == 0 && (uint64_t) st.st_size == loc->uncompressedSize)
+			{
+				auto done = finished.find(loc->crc);
+				/* A patch may change the content of a file but not its size */
+				if (done != finished.end() && done->second.size == loc->uncompressedSize && done->second.mtime == mtime_of(st)
+					&& memcmp(done->second.md5, loc->chkUncompressed, 16) == 0)
+				{
+					upToDate++;
+					continue;
+				}
+
+				md5_byte_t digest[16];
+				if (md5_file(j.path, digest, data))
+				{
+					bytesHashed += st.st_size;
+					if (memcmp(digest, loc->chkUncompressed, 16) == 0)
+					{
+						record(loc, st);
+						upToDate++;
+						continue;
+					}
+				}
+			}
+
+			/* Stored files are written straight from the mapping */
+			const char* out = pack.data(*loc);
+			if (out == nullptr)
+			{
+				failed++;
+				continue;
+			}
+			bytesIn += pack_reader::stored_size(*loc);
+
+			if (loc->compressed())
+			{
+				data.resize(loc->uncompressedSize);
+				unsigned helpers = loc->uncompressedSize >= SPLIT_SIZE ? borrow() : 0;
+				bool ok = pack.read(*loc, data.data(), 1 + helpers);
+				lent -= helpers;
+				if (!ok)
+				{
+					std::lock_guard<std::mutex> lock(logMutex);
+					std::cerr << "Could not decompress '" << j.path << "'" << std::endl;
+					failed++;
+					continue;
+				}
+				out = data.data();
+			}
+
+			std::ofstream file(j.path, std::ios::binary);
+			file.write(out, loc->uncompressedSize);
+			if (!file)
+			{
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cerr << "Could not write '" << j.path << "'" << std::endl;
+				failed++;
+				continue;
+			}
+
+			file.close();
+			if (stat(j.path.c_str(), &st) == 0) record(loc, st);
+
+			files++;
+			bytesOut += loc->uncompressedSize;
+
+			if (verbose)
+			{
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cout << "Extracted: " << j.path << std::endl;
+			}
+		}
+
+		packsDone++;
+	});
+
+	/* A complete run leaves nothing to resume, any other keeps one record per file */
+	if (journal != nullptr)
+	{
+		fclose(journal);
+		if (failed == 0)
+		{
+			remove(journal_path().c_str());
+		}
+		else
+		{
+			for (const journal_record& entry : recorded) finished[entry.crc] = entry;
+
+			journal = fopen(journal_path().c_str(), "wb");
+			if (journal != nullptr)
+			{
+				for (const auto& entry : finished) fwrite(&entry.second, sizeof(journal_record), 1, journal);
+				fclose(journal);
+			}
+		}
+	}
+
+	extract_stats stats;
+	stats.files = files;
+	stats.upToDate = upToDate;
+	stats.bytesHashed = bytesHashed;
+	stats.failed = failed;
+	stats.bytesIn = bytesIn;
+	stats.bytesOut = bytesOut;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "catalog_view.hpp"
+#include "pack_index.hpp"
+
+/**
+ *	The totals of an extraction
+ */
+struct extract_stats
+{
+	uint64_t files = 0;		// Files written
+	uint64_t upToDate = 0;	// Files skipped because the output already matches
+	uint64_t bytesHashed = 0;	// Bytes of existing output that were checked
+	uint64_t failed = 0;	// Files that could not be read or written
+	uint64_t bytesIn = 0;	// Bytes read from the packs
+	uint64_t bytesOut = 0;	// Bytes written to the output
+	double seconds = 0;
+};
+
+/*
+ * Extracts files from the packs of a client.
+ *
+ * The files are grouped by pack and sorted by data address, so that each
+ * pack is read front to back through a single mapping. Packs are handed
+ * out to the worker threads, largest first; each worker decompresses into
+ * a reused buffer and writes the file in one go. Once workers run out
+ * of packs, they help with the blocks of the large files of the others,
+ * so that a single big asset at the end of a run does not leave the
+ * other cores idle.
+ *
+ * In incremental mode, an existing output file with the right size and
+ * MD5 is kept as is. Every finished file is recorded in a journal in the
+ * output directory, so that a run that was interrupted skips those files
+ * without hashing them again. The journal is removed after a clean run,
+ * and rewritten with one record per file after any other.
+ */
+class pack_extractor {
+
+	struct job
+	{
+		const pack_location* loc;
+		std::string path;
+	};
+
+	const catalog_view& catalog;
+	const pack_index& locations;
+	std::string baseDir;
+	std::string outDir;
+
+	std::vector<std::vector<job>> packs;	// The jobs for each pack
+	uint64_t skipped = 0;
+
+	// The path of the journal for the output directory
+	std::string journal_path() const;
+
+public:
+	bool verbose = false;
+	bool incremental = false;
+
+	pack_extractor(const catalog_view& catalog, const pack_index& locations, const std::string& baseDir, const std::string& outDir);
+
+	// Adds a client path to extract, returns false if it is in no pack
+	bool add(const std::string& path);
+
+	// The number of added paths that are in no pack
+	uint64_t missing() const { return skipped; }
+
+	// Extracts all added files on `threads` threads (0 for all cores)
+	extract_stats run(unsigned threads);
+};
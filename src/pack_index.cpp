@@ -0,0 +1,268 @@
+#include "pack_index.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+#include <assembly/package.hpp>
+
+#include "catalog_view.hpp"
+
+#define PACK_INDEX_VERSION 2
+
+using namespace assembly::package;
+
+static const char PACK_INDEX_MAGIC[4] = {'P', 'K', 'X', 'I'};
+
+void md5_to_hex(const uint8_t* md5, char* hex)
+{
+	const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < 16; i++)
+	{
+		hex[2 * i] = digits[md5[i] >> 4];
+		hex[2 * i + 1] = digits[md5[i] & 0xF];
+	}
+}
+
+static int hex_value(char c)
+{
+	if ('0' <= c && c <= '9') return c - '0';
+	if ('a' <= c && c <= 'f') return c - 'a' + 10;
+	if ('A' <= c && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+bool md5_from_hex(const char* hex, uint8_t* md5)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		int hi = hex_value(hex[2 * i]);
+		int lo = hex_value(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0) return false;
+		md5[i] = (uint8_t) (hi << 4 | lo);
+	}
+	return true;
+}
+
+/**
+ *	Reads the size and mtime of a file, or marks it as missing
+ */
+static void stat_file(const std::string& path, pack_state& state)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+	{
+		state.size = PACK_STATE_MISSING;
+		state.mtime = 0;
+		return;
+	}
+	state.size = st.st_size;
+	state.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/**
+ *	The path of a pack of the catalog on disk
+ */
+static std::string pack_path(const catalog_view& catalog, uint32_t pack, const std::string& baseDir)
+{
+	std::string path = catalog.pack_name(pack);
+	std::replace(path.begin(), path.end(), '\\', '/');
+	return baseDir + path;
+}
+
+/**
+ *	Points the table at an image of the index file after checking it
+ */
+bool pack_index::attach(const char* data, std::size_t size)
+{
+	if (size < sizeof(pack_index_header)) return false;
+
+	const pack_index_header* head = (const pack_index_header*) data;
+	if (memcmp(head->magic, PACK_INDEX_MAGIC, 4) != 0 || head->version != PACK_INDEX_VERSION) return false;
+
+	uint32_t slotCount = head->slotCount;
+	if (slotCount < 2 || (slotCount & (slotCount - 1)) != 0 || head->recordCount >= slotCount) return false;
+
+	uint64_t expected = sizeof(pack_index_header)
+		+ (uint64_t) head->packCount * sizeof(pack_state)
+		+ (uint64_t) slotCount * sizeof(slot)
+		+ (uint64_t) head->recordCount * sizeof(pack_location);
+	if (size != expected) return false;
+
+	std::size_t packBytes = (std::size_t) head->packCount * sizeof(pack_state);
+	header = head;
+	packs = (const pack_state*) (data + sizeof(pack_index_header));
+	slots = (const slot*) (data + sizeof(pack_index_header) + packBytes);
+	records = (const pack_location*) (data + sizeof(pack_index_header) + packBytes + (std::size_t) slotCount * sizeof(slot));
+	mask = slotCount - 1;
+	shift = 32;
+	for (uint32_t n = slotCount; n > 1; n >>= 1) shift--;
+	return true;
+}
+
+bool pack_index::open(const std::string& path)
+{
+	close();
+	if (!file.open(path)) return false;
+	if (!attach(file.data(), file.size()))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void pack_index::close()
+{
+	file.close();
+	image.clear();
+	header = nullptr;
+	packs = nullptr;
+	slots = nullptr;
+	records = nullptr;
+	mask = 0;
+	shift = 0;
+}
+
+bool pack_index::build(const std::string& catalogPath, const std::string& baseDir)
+{
+	close();
+
+	catalog_view catalog;
+	if (!catalog.open(catalogPath)) return false;
+
+	pack_state catalogState;
+	stat_file(catalogPath, catalogState);
+	if (catalogState.size == PACK_STATE_MISSING) return false;
+
+	/* Start with what the catalog knows */
+	std::vector<pack_location> locations(catalog.file_count());
+	for (uint32_t i = 0; i < catalog.file_count(); i++)
+	{
+		catalog_record entry = catalog.entry(i);
+		pack_location& loc = locations[i];
+		memset(&loc, 0, sizeof(pack_location));
+		loc.crc = entry.crc;
+		loc.pack = entry.pack;
+	}
+
+	/* Fill in the details from the pack headers, noting each pack before it is read */
+	std::vector<pack_state> states(catalog.pack_count());
+	for (uint32_t p = 0; p < catalog.pack_count(); p++)
+	{
+		std::string path = pack_path(catalog, p, baseDir);
+		stat_file(path, states[p]);
+
+		package_info info;
+		if (states[p].size == PACK_STATE_MISSING || read_from_file(path, info) != 0) continue;
+
+		for (const package_info_entry& entry : info.files)
+		{
+			int32_t index = catalog.find(entry.crc);
+			if (index == -1 || catalog.entry(index).pack != p) continue;
+
+			package_ptr ptr = find_by_crc(&info, entry.crc);
+			if (!ptr.valid()) continue;
+
+			char hex[36];
+			pack_location& loc = locations[index];
+			loc.dataAddress = ptr.dataAddress();
+			loc.compressedSize = ptr.compressedSize();
+			loc.uncompressedSize = ptr.uncompressedSize();
+			loc.flags = PACK_LOCATION_PRESENT | (ptr.compressed() ? PACK_LOCATION_COMPRESSED : 0);
+			ptr.chkUncompressed(hex);
+			md5_from_hex(hex, loc.chkUncompressed);
+			ptr.chkCompressed(hex);
+			md5_from_hex(hex, loc.chkCompressed);
+		}
+	}
+
+	/* Keep the load factor at or below one half */
+	uint32_t slotCount = 2;
+	while (slotCount < 2 * (uint64_t) locations.size()) slotCount <<= 1;
+
+	std::size_t packBytes = states.size() * sizeof(pack_state);
+	std::size_t slotBytes = (std::size_t) slotCount * sizeof(slot);
+	std::vector<char> data(sizeof(pack_index_header) + packBytes + slotBytes + locations.size() * sizeof(pack_location), 0);
+
+	pack_index_header* head = (pack_index_header*) data.data();
+	memcpy(head->magic, PACK_INDEX_MAGIC, 4);
+	head->version = PACK_INDEX_VERSION;
+	head->slotCount = slotCount;
+	head->recordCount = locations.size();
+	head->catalogSize = catalogState.size;
+	head->catalogMtime = catalogState.mtime;
+	head->packCount = states.size();
+	memcpy(data.data() + sizeof(pack_index_header), states.data(), packBytes);
+
+	uint32_t bits = 0;
+	while (((uint32_t) 1 << bits) < slotCount) bits++;
+
+	slot* table = (slot*) (data.data() + sizeof(pack_index_header) + packBytes);
+	for (uint32_t i = 0; i < locations.size(); i++)
+	{
+		uint32_t pos = (locations[i].crc * 0x9E3779B1u) >> (32 - bits);
+		while (table[pos].record != 0) pos = (pos + 1) & (slotCount - 1);
+		table[pos].crc = locations[i].crc;
+		table[pos].record = i + 1;
+	}
+
+	memcpy(data.data() + sizeof(pack_index_header) + packBytes + slotBytes, locations.data(), locations.size() * sizeof(pack_location));
+
+	image.swap(data);
+	return attach(image.data(), image.size());
+}
+
+bool pack_index::write(const std::string& path) const
+{
+	if (header == nullptr) return false;
+
+	std::size_t size = sizeof(pack_index_header)
+		+ (std::size_t) header->packCount * sizeof(pack_state)
+		+ (std::size_t) header->slotCount * sizeof(slot)
+		+ (std::size_t) header->recordCount * sizeof(pack_location);
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out.is_open()) return false;
+	out.write((const char*) header, size);
+	return out.good();
+}
+
+bool pack_index::fresh(const std::string& catalogPath, const std::string& baseDir) const
+{
+	if (header == nullptr) return false;
+
+	pack_state state;
+	stat_file(catalogPath, state);
+	if (state.size == PACK_STATE_MISSING || header->catalogSize != state.size || header->catalogMtime != state.mtime) return false;
+
+	/* A pack that was replaced or patched may have moved its files */
+	catalog_view catalog;
+	if (!catalog.open(catalogPath) || catalog.pack_count() != header->packCount) return false;
+
+	for (uint32_t p = 0; p < header->packCount; p++)
+	{
+		if (!pack_fresh(p, pack_path(catalog, p, baseDir))) return false;
+	}
+	return true;
+}
+
+bool pack_index::pack_fresh(uint32_t pack, const std::string& packPath) const
+{
+	if (header == nullptr || pack >= header->packCount) return false;
+
+	pack_state state;
+	stat_file(packPath, state);
+	return packs[pack].size == state.size && packs[pack].mtime == state.mtime;
+}
+
+std::string pack_index::sidecar_path(const std::string& catalogPath)
+{
+	std::string::size_type len = catalogPath.size();
+	if (len >= 4 && catalogPath.compare(len - 4, 4, ".pki") == 0)
+	{
+		return catalogPath.substr(0, len - 4) + ".pkx";
+	}
+	return catalogPath + ".pkx";
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+#define PACK_LOCATION_COMPRESSED 1	// The data is sd0 compressed
+#define PACK_LOCATION_PRESENT 2		// The pack file has an entry for the CRC
+
+#define PACK_STATE_MISSING UINT64_MAX	// The size of a pack that could not be found
+
+/**
+ *	Where the data for a CRC is, merged from the catalog and the pack header
+ */
+struct pack_location
+{
+	uint32_t crc;
+	uint32_t pack;
+	uint32_t dataAddress;
+	uint32_t compressedSize;
+	uint32_t uncompressedSize;
+	uint32_t flags;
+	uint8_t chkUncompressed[16];
+	uint8_t chkCompressed[16];
+
+	bool present() const { return (flags & PACK_LOCATION_PRESENT) != 0; }
+	bool compressed() const { return (flags & PACK_LOCATION_COMPRESSED) != 0; }
+};
+
+/**
+ *	The fixed size start of an index file
+ */
+struct pack_index_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t recordCount;
+	uint64_t catalogSize;
+	int64_t catalogMtime;
+	uint32_t packCount;
+	uint32_t reserved;
+};
+
+/**
+ *	The size and mtime of a pack when the index was built
+ */
+struct pack_state
+{
+	uint64_t size;		// PACK_STATE_MISSING if there was no such file
+	int64_t mtime;
+};
+
+/*
+ * An open-addressing hash table from CRC to pack_location, covering the
+ * catalog and the headers of all its packs.
+ *
+ * The table is built in memory from a catalog, and can be written to a
+ * sidecar file (primary.pki -> primary.pkx) that is mapped on later runs.
+ * The sidecar remembers the size and mtime of the catalog and of each
+ * pack it was built from, and is only fresh while all of them are the same.
+ */
+class pack_index {
+
+	struct slot
+	{
+		uint32_t crc;
+		uint32_t record;	// Index of the record + 1, 0 for empty slots
+	};
+
+	mapped_file file;
+	std::vector<char> image;
+
+	const pack_index_header* header = nullptr;
+	const pack_state* packs = nullptr;
+	const slot* slots = nullptr;
+	const pack_location* records = nullptr;
+	uint32_t mask = 0;
+	uint32_t shift = 0;
+
+	bool attach(const char* data, std::size_t size);
+
+public:
+	// Maps a sidecar file, returns false if it is missing or invalid
+	bool open(const std::string& path);
+
+	// Builds the index for a catalog, with the packs relative to baseDir
+	bool build(const std::string& catalogPath, const std::string& baseDir);
+
+	// Writes the index to a sidecar file
+	bool write(const std::string& path) const;
+
+	// Drops the index
+	void close();
+
+	// Whether the index was built from the catalog and the packs as they are now
+	bool fresh(const std::string& catalogPath, const std::string& baseDir) const;
+
+	// Whether a single pack is as it was when the index was built
+	bool pack_fresh(uint32_t pack, const std::string& packPath) const;
+
+	bool is_open() const { return header != nullptr; }
+	uint32_t size() const { return header ? header->recordCount : 0; }
+	const pack_location& at(uint32_t index) const { return records[index]; }
+
+	// Returns the location of a CRC, or null
+	const pack_location* find(uint32_t crc) const
+	{
+		if (header == nullptr) return nullptr;
+		for (uint32_t pos = (crc * 0x9E3779B1u) >> shift; slots[pos].record != 0; pos = (pos + 1) & mask)
+		{
+			if (slots[pos].crc == crc) return &records[slots[pos].record - 1];
+		}
+		return nullptr;
+	}
+
+	// The default sidecar path for a catalog
+	static std::string sidecar_path(const std::string& catalogPath);
+};
+
+/**
+ *	Writes 16 checksum bytes as 32 lowercase hex digits (not terminated)
+ */
+void md5_to_hex(const uint8_t* md5, char* hex);
+
+/**
+ *	Reads 32 hex digits into 16 checksum bytes, returns false on bad input
+ */
+bool md5_from_hex(const char* hex, uint8_t* md5);
@@ -0,0 +1,37 @@
+#include "pack_reader.hpp"
+
+#include <cstring>
+
+bool pack_reader::open(const std::string& path)
+{
+	return file.open(path);
+}
+
+uint32_t pack_reader::stored_size(const pack_location& loc)
+{
+	return loc.compressed() ? loc.compressedSize : loc.uncompressedSize;
+}
+
+const char* pack_reader::data(const pack_location& loc) const
+{
+	uint64_t end = (uint64_t) loc.dataAddress + stored_size(loc);
+	if (!loc.present() || end > file.size()) return nullptr;
+	return file.data() + loc.dataAddress;
+}
+
+bool pack_reader::read(const pack_location& loc, char* dst, unsigned threads)
+{
+	const char* src = data(loc);
+	if (src == nullptr) return false;
+
+	if (!loc.compressed())
+	{
+		memcpy(dst, src, loc.uncompressedSize);
+		return true;
+	}
+
+	int64_t have = threads == 1
+		? decoder.decode(src, loc.compressedSize, dst, loc.uncompressedSize)
+		: sd0_decode_parallel(src, loc.compressedSize, dst, loc.uncompressedSize, threads);
+	return have == loc.uncompressedSize;
+}
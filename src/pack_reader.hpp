@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "pack_index.hpp"
+#include "sd0_codec.hpp"
+
+/*
+ * A pack file (*.pk), mapped into memory.
+ *
+ * The data of a file is read straight from the mapping: stored files are
+ * handed out in place, compressed ones are inflated into the caller's
+ * buffer. The sizes come from the pack_location, so nothing in between
+ * is buffered or copied.
+ */
+class pack_reader {
+
+	mapped_file file;
+	sd0_decoder decoder;
+
+public:
+	// Maps a pack file, returns false if it can't be opened
+	bool open(const std::string& path);
+
+	// Unmaps the pack
+	void close() { file.close(); }
+
+	bool is_open() const { return file.is_open(); }
+
+	// Tells the kernel how the pack will be read
+	void advise(int advice) const { file.advise(advice); }
+
+	// The stored bytes of a file, or nullptr if they are not within the pack
+	const char* data(const pack_location& loc) const;
+
+	// The number of stored bytes of a file
+	static uint32_t stored_size(const pack_location& loc);
+
+	// Inflates or copies a file into dst, which must hold loc.uncompressedSize bytes
+	bool read(const pack_location& loc, char* dst, unsigned threads = 1);
+};
@@ -0,0 +1,353 @@
+#include "pack_recover.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "crc.hpp"
+#include "parallel.hpp"
+
+/* Adjacent segments are merged into one when this doesn't create more choices */
+#define MERGE_LIMIT 65536
+
+/* The number of tasks per thread, so that uneven subtrees balance out */
+#define TASKS_PER_THREAD 64
+
+using namespace recover;
+
+void segment::add(const std::string& text)
+{
+	alternative alt;
+	alt.text = text;
+	alt.crc = crc::update(0, text.data(), text.size());
+	alt.fin = crc::finish(alt.crc) ^ crc::finish(0);
+
+	for (length_group& group : groups)
+	{
+		if (group.length == text.size())
+		{
+			group.alts.push_back(alt);
+			count++;
+			return;
+		}
+	}
+
+	groups.push_back({text.size(), {alt}});
+	count++;
+}
+
+uint64_t pattern::count() const
+{
+	uint64_t total = 1;
+	for (const segment& seg : segments)
+	{
+		total *= seg.count;
+	}
+	return total;
+}
+
+static bool is_digit(char c)
+{
+	return '0' <= c && c <= '9';
+}
+
+/**
+ *	Adds the expansion of one item within braces to a segment
+ */
+static bool expand_item(const std::string& item, segment& seg, std::string& error)
+{
+	if (!item.empty() && item[0] == '@')
+	{
+		std::ifstream file(item.substr(1));
+		if (!file.is_open())
+		{
+			error = "Could not open dictionary '" + item.substr(1) + "'";
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) seg.add(line);
+		}
+		return true;
+	}
+
+	std::string::size_type dash = item.find('-');
+	bool is_range = dash != std::string::npos && dash > 0 && dash + 1 < item.size()
+		&& std::all_of(item.begin(), item.begin() + dash, is_digit)
+		&& std::all_of(item.begin() + dash + 1, item.end(), is_digit);
+
+	if (is_range)
+	{
+		std::string lower = item.substr(0, dash);
+		uint64_t from = std::stoull(lower);
+		uint64_t to = std::stoull(item.substr(dash + 1));
+		std::size_t width = (lower.size() > 1 && lower[0] == '0') ? lower.size() : 0;
+
+		for (uint64_t i = from; i <= to; i++)
+		{
+			std::stringstream num;
+			num << std::setw(width) << std::setfill('0') << i;
+			seg.add(num.str());
+		}
+		return true;
+	}
+
+	seg.add(item);
+	return true;
+}
+
+/**
+ *	Replaces two segments with one that has all their combinations
+ */
+static segment combine(const segment& a, const segment& b)
+{
+	segment result;
+	for (const length_group& ga : a.groups)
+		for (const alternative& aa : ga.alts)
+			for (const length_group& gb : b.groups)
+				for (const alternative& ab : gb.alts)
+					result.add(aa.text + ab.text);
+	return result;
+}
+
+bool recover::parse(const std::string& text, pattern& out, std::string& error)
+{
+	std::vector<segment> segments;
+	std::string literal;
+
+	for (std::string::size_type i = 0; i < text.size(); i++)
+	{
+		char c = text[i];
+		if (c == '}')
+		{
+			error = "Unexpected '}' at position " + std::to_string(i);
+			return false;
+		}
+		else if (c != '{')
+		{
+			literal += c;
+			continue;
+		}
+
+		std::string::size_type close = text.find('}', i);
+		if (close == std::string::npos)
+		{
+			error = "Missing '}' for '{' at position " + std::to_string(i);
+			return false;
+		}
+
+		if (!literal.empty())
+		{
+			segments.push_back(segment());
+			segments.back().add(literal);
+			literal.clear();
+		}
+
+		segment seg;
+		std::stringstream items(text.substr(i + 1, close - i - 1));
+		std::string item;
+		while (std::getline(items, item, ','))
+		{
+			if (!expand_item(item, seg, error)) return false;
+		}
+		/* getline drops an empty last item, as in "{,x}" vs "{x,}" */
+		if (close > i + 1 && text[close - 1] == ',') seg.add("");
+		if (close == i + 1) seg.add("");
+
+		if (seg.count == 0)
+		{
+			error = "Choice at position " + std::to_string(i) + " is empty";
+			return false;
+		}
+
+		segments.push_back(seg);
+		i = close;
+	}
+
+	if (!literal.empty() || segments.empty())
+	{
+		segments.push_back(segment());
+		segments.back().add(literal);
+	}
+
+	/* Fixed text never needs its own segment */
+	for (std::size_t i = 0; i + 1 < segments.size();)
+	{
+		if (segments[i].count == 1 || segments[i + 1].count == 1)
+		{
+			segments[i] = combine(segments[i], segments[i + 1]);
+			segments.erase(segments.begin() + i + 1);
+		}
+		else i++;
+	}
+
+	/* The innermost loop is the cheapest, so make the last segment large */
+	while (segments.size() > 1)
+	{
+		segment& a = segments[segments.size() - 2];
+		segment& b = segments.back();
+		if (a.count * b.count > MERGE_LIMIT) break;
+
+		a = combine(a, b);
+		segments.pop_back();
+	}
+
+	out.segments = segments;
+	return true;
+}
+
+crc_set::crc_set(std::vector<uint32_t> values) : filter(((std::size_t) 1 << 24) / 64, 0), crcs(values)
+{
+	std::sort(crcs.begin(), crcs.end());
+	crcs.erase(std::unique(crcs.begin(), crcs.end()), crcs.end());
+
+	for (uint32_t crc : crcs)
+	{
+		uint32_t bit = crc >> 8;
+		filter[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+	}
+}
+
+bool crc_set::contains_exact(uint32_t crc) const
+{
+	return std::binary_search(crcs.begin(), crcs.end(), crc);
+}
+
+/**
+ *	The state of one worker: the choices made so far and its matches
+ */
+struct walker
+{
+	const pattern* pat;
+	const crc_set* targets;
+	std::vector<const alternative*> chosen;
+	std::vector<match> matches;
+
+	void emit(std::size_t depth, const alternative& last, uint32_t crc)
+	{
+		std::string path;
+		for (std::size_t i = 0; i < depth; i++)
+		{
+			path += chosen[i]->text;
+		}
+		matches.push_back({crc, path + last.text});
+	}
+
+	// Expands the pattern from `depth`, with only the alternatives [first, last) of that segment
+	void walk(std::size_t depth, uint32_t state, uint64_t first = 0, uint64_t last = UINT64_MAX)
+	{
+		const segment& seg = pat->segments[depth];
+		bool leaf = depth + 1 == pat->segments.size();
+
+		uint64_t index = 0;
+		for (const length_group& group : seg.groups)
+		{
+			uint64_t begin = index;
+			index += group.alts.size();
+			if (index <= first || begin >= last) continue;
+
+			std::size_t from = first > begin ? first - begin : 0;
+			std::size_t to = std::min<uint64_t>(group.alts.size(), last - begin);
+
+			if (leaf)
+			{
+				uint32_t base = crc::finish(crc::zeros(state, group.length));
+				for (std::size_t i = from; i < to; i++)
+				{
+					uint32_t crc = base ^ group.alts[i].fin;
+					if (targets->contains(crc)) emit(depth, group.alts[i], crc);
+				}
+				continue;
+			}
+
+			uint32_t shifted = crc::zeros(state, group.length);
+			for (std::size_t i = from; i < to; i++)
+			{
+				chosen[depth] = &group.alts[i];
+				walk(depth + 1, shifted ^ group.alts[i].crc);
+			}
+		}
+	}
+};
+
+/**
+ *	A prefix of the pattern that is expanded by one worker
+ */
+struct task
+{
+	uint32_t state;
+	std::vector<const alternative*> chosen;
+};
+
+static void split(const pattern& pat, std::size_t depth, task& current, std::vector<task>& tasks)
+{
+	if (current.chosen.size() == depth)
+	{
+		tasks.push_back(current);
+		return;
+	}
+
+	const segment& seg = pat.segments[current.chosen.size()];
+	uint32_t state = current.state;
+	for (const length_group& group : seg.groups)
+	{
+		uint32_t shifted = crc::zeros(state, group.length);
+		for (const alternative& alt : group.alts)
+		{
+			current.state = shifted ^ alt.crc;
+			current.chosen.push_back(&alt);
+			split(pat, depth, current, tasks);
+			current.chosen.pop_back();
+		}
+	}
+	current.state = state;
+}
+
+void recover::search(const pattern& pat, const crc_set& targets, unsigned threads, std::vector<match>& matches)
+{
+	if (threads == 0) threads = parallel::default_threads();
+
+	/* Expand prefixes until there is enough work to hand out */
+	std::size_t depth = 0;
+	uint64_t prefixes = 1;
+	while (depth + 1 < pat.segments.size() && prefixes < (uint64_t) threads * TASKS_PER_THREAD)
+	{
+		prefixes *= pat.segments[depth++].count;
+	}
+
+	std::vector<task> tasks;
+	task root = {crc::INIT, {}};
+	split(pat, depth, root, tasks);
+
+	/* Too few prefixes, like for a single segment, split the segment after them into ranges */
+	uint64_t wanted = (uint64_t) threads * TASKS_PER_THREAD;
+	uint64_t next = pat.segments[depth].count;
+	uint64_t chunks = prefixes < wanted ? std::max<uint64_t>(1, std::min(next, (wanted + prefixes - 1) / prefixes)) : 1;
+	uint64_t chunk = (next + chunks - 1) / chunks;
+
+	std::vector<walker> walkers(threads);
+	for (walker& w : walkers)
+	{
+		w.pat = &pat;
+		w.targets = &targets;
+		w.chosen.resize(pat.segments.size());
+	}
+
+	parallel::for_each(tasks.size() * chunks, threads, [&](std::size_t i, unsigned worker)
+	{
+		walker& w = walkers[worker];
+		const task& t = tasks[i / chunks];
+		uint64_t first = (i % chunks) * chunk;
+		std::copy(t.chosen.begin(), t.chosen.end(), w.chosen.begin());
+		w.walk(depth, t.state, first, first + chunk);
+	});
+
+	for (walker& w : walkers)
+	{
+		matches.insert(matches.end(), w.matches.begin(), w.matches.end());
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Recovery of the filenames behind catalog CRCs that no manifest resolves.
+ *
+ * Candidates are described by patterns: literal text mixed with choices
+ * in braces, e.g. `client/res/textures/{@dirs.txt}/tile_{00-99}.{dds,png}`.
+ * A choice is a comma separated list of items, each of which is either
+ * literal text, a numeric range `a-b` (zero padded to the width of `a`)
+ * or `@file` for the lines of a dictionary file.
+ */
+namespace recover
+{
+	/**
+	 *	One choice of a segment, with its CRC contribution precomputed
+	 */
+	struct alternative
+	{
+		std::string text;
+		uint32_t crc;	// crc::update(0, text)
+		uint32_t fin;	// crc::finish(crc) ^ crc::finish(0)
+	};
+
+	/**
+	 *	The choices of a segment that have the same length
+	 */
+	struct length_group
+	{
+		std::size_t length;
+		std::vector<alternative> alts;
+	};
+
+	/**
+	 *	A position in the pattern with its possible choices
+	 */
+	struct segment
+	{
+		std::vector<length_group> groups;
+		uint64_t count = 0;
+
+		void add(const std::string& text);
+	};
+
+	/**
+	 *	A parsed candidate pattern
+	 */
+	struct pattern
+	{
+		std::vector<segment> segments;
+
+		// The number of candidates this pattern generates
+		uint64_t count() const;
+	};
+
+	/**
+	 *	Parses a pattern, returns false and sets `error` if it is invalid
+	 */
+	bool parse(const std::string& text, pattern& out, std::string& error);
+
+	/**
+	 *	The set of CRCs to look for, with a bitmap in front of the
+	 *	sorted list so that most candidates are rejected by one load.
+	 */
+	class crc_set
+	{
+		std::vector<uint64_t> filter;
+		std::vector<uint32_t> crcs;
+
+	public:
+		crc_set(std::vector<uint32_t> values);
+
+		std::size_t size() const { return crcs.size(); }
+
+		bool contains(uint32_t crc) const
+		{
+			uint32_t bit = crc >> 8;
+			if ((filter[bit >> 6] & ((uint64_t) 1 << (bit & 63))) == 0) return false;
+			return contains_exact(crc);
+		}
+
+		bool contains_exact(uint32_t crc) const;
+	};
+
+	struct match
+	{
+		uint32_t crc;
+		std::string path;
+	};
+
+	/**
+	 *	Generates all candidates of the pattern on `threads` threads and
+	 *	appends the ones with a CRC in `targets` to `matches`.
+	 */
+	void search(const pattern& pat, const crc_set& targets, unsigned threads, std::vector<match>& matches);
+}
@@ -0,0 +1,214 @@
+#include "pack_verify.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <cstring>
+
+#include "parallel.hpp"
+#include "pack_reader.hpp"
+#include "md5_multi.hpp"
+
+#define RUN_SIZE (32 << 20)		// The stored bytes per unit of work
+#define BATCH_SIZE (16 << 20)	// The bytes hashed together
+#define BATCH_FILES 64			// The files hashed together
+
+/**
+ *	A file waiting for its checksums, with the index of each in the batch
+ */
+struct verify_pending
+{
+	const pack_location* loc;
+	int compressed;		// -1 if the stored data has no checksum
+	int uncompressed;
+};
+
+/**
+ *	Neighbouring files in one pack, checked by one worker
+ */
+struct verify_run
+{
+	uint32_t pack;
+	std::size_t first;
+	std::size_t last;
+};
+
+static bool has_checksum(const uint8_t* md5)
+{
+	static const uint8_t zero[16] = {0};
+	return memcmp(md5, zero, 16) != 0;
+}
+
+pack_verifier::pack_verifier(const catalog_view& catalog, const pack_index& locations, const std::string& baseDir)
+	: catalog(catalog), locations(locations), baseDir(baseDir)
+{
+}
+
+verify_stats pack_verifier::run(unsigned threads)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	failed.clear();
+
+	verify_stats stats;
+
+	/* Read each pack front to back */
+	std::vector<const pack_location*> files;
+	for (uint32_t i = 0; i < locations.size(); i++)
+	{
+		const pack_location& loc = locations.at(i);
+		if (loc.present()) files.push_back(&loc);
+		else stats.notPacked++;
+	}
+
+	std::sort(files.begin(), files.end(), [](const pack_location* a, const pack_location* b)
+	{
+		return a->pack != b->pack ? a->pack < b->pack : a->dataAddress < b->dataAddress;
+	});
+
+	std::vector<verify_run> runs;
+	uint64_t runBytes = 0;
+	for (std::size_t i = 0; i < files.size(); i++)
+	{
+		if (runs.empty() || runs.back().pack != files[i]->pack || runBytes >= RUN_SIZE)
+		{
+			runs.push_back({files[i]->pack, i, i});
+			runBytes = 0;
+		}
+		runs.back().last = i;
+		runBytes += pack_reader::stored_size(*files[i]);
+	}
+
+	std::atomic<uint64_t> checked(0), ok(0), bytesIn(0), bytesOut(0);
+	std::mutex failMutex;
+
+	auto fail = [&](const pack_location* loc, const std::string& reason)
+	{
+		std::lock_guard<std::mutex> lock(failMutex);
+		failed.push_back({loc->crc, reason});
+		if (verbose) std::cerr << "Failed " << loc->crc << ": " << reason << std::endl;
+	};
+
+	if (threads == 0) threads = parallel::default_threads();
+	std::vector<std::vector<std::vector<char>>> buffers(threads);
+	std::vector<std::unique_ptr<sd0_decoder>> decoders(threads);
+
+	parallel::for_each(runs.size(), threads, [&](std::size_t r, unsigned worker)
+	{
+		const verify_run& run = runs[r];
+		std::string packPath = catalog.pack_name(run.pack);
+		std::replace(packPath.begin(), packPath.end(), '\\', '/');
+
+		pack_reader pack;
+		if (!pack.open(baseDir + packPath))
+		{
+			for (std::size_t i = run.first; i <= run.last; i++) fail(files[i], "could not open " + packPath);
+			checked += run.last - run.first + 1;
+			return;
+		}
+
+		pack.advise(MADV_SEQUENTIAL);
+		if (!decoders[worker]) decoders[worker].reset(new sd0_decoder());
+
+		/* The files are inflated into their own buffers, and hashed in batches on all vector lanes */
+		std::vector<std::vector<char>>& inflated = buffers[worker];
+		std::vector<md5_buffer> hashes;
+		std::vector<verify_pending> pending;
+		std::size_t used = 0;
+		uint64_t batchBytes = 0;
+
+		auto flush = [&]
+		{
+			md5_multi(hashes.data(), hashes.size());
+			for (const verify_pending& file : pending)
+			{
+				if (file.compressed != -1 && memcmp(hashes[file.compressed].digest, file.loc->chkCompressed, 16) != 0)
+				{
+					fail(file.loc, "compressed checksum mismatch");
+				}
+				else if (memcmp(hashes[file.uncompressed].digest, file.loc->chkUncompressed, 16) != 0)
+				{
+					fail(file.loc, "checksum mismatch");
+				}
+				else ok++;
+			}
+			hashes.clear();
+			pending.clear();
+
+			/* Only keep buffers of a usual size around */
+			for (std::size_t b = 0; b < used; b++)
+			{
+				if (inflated[b].capacity() > BATCH_SIZE) std::vector<char>().swap(inflated[b]);
+			}
+			used = 0;
+			batchBytes = 0;
+		};
+
+		for (std::size_t i = run.first; i <= run.last; i++)
+		{
+			const pack_location* loc = files[i];
+			checked++;
+
+			const char* stored = pack.data(*loc);
+			if (stored == nullptr)
+			{
+				fail(loc, "data is past the end of " + packPath);
+				continue;
+			}
+
+			uint32_t storedSize = pack_reader::stored_size(*loc);
+			bytesIn += storedSize;
+
+			/* Stored files are hashed straight from the mapping */
+			const char* out = stored;
+			if (loc->compressed())
+			{
+				if (used == inflated.size()) inflated.emplace_back();
+				std::vector<char>& data = inflated[used];
+
+				/* Data that inflates to more than the header says fails to fit */
+				data.resize(loc->uncompressedSize);
+				int64_t have = decoders[worker]->decode(stored, storedSize, data.data(), data.size());
+				if (have < 0)
+				{
+					fail(loc, "could not decompress, or too large");
+					continue;
+				}
+				if (have != loc->uncompressedSize)
+				{
+					fail(loc, "size mismatch (" + std::to_string(have) + " instead of " + std::to_string(loc->uncompressedSize) + ")");
+					continue;
+				}
+				out = data.data();
+				used++;
+			}
+			bytesOut += loc->uncompressedSize;
+
+			verify_pending file = {loc, -1, -1};
+			if (loc->compressed() && has_checksum(loc->chkCompressed))
+			{
+				file.compressed = hashes.size();
+				hashes.push_back({stored, storedSize, {0}});
+			}
+			file.uncompressed = hashes.size();
+			hashes.push_back({out, loc->uncompressedSize, {0}});
+			pending.push_back(file);
+
+			batchBytes += storedSize + loc->uncompressedSize;
+			if (batchBytes >= BATCH_SIZE || pending.size() >= BATCH_FILES) flush();
+		}
+
+		flush();
+	});
+
+	std::sort(failed.begin(), failed.end(), [](const verify_failure& a, const verify_failure& b) { return a.crc < b.crc; });
+
+	stats.files = checked;
+	stats.ok = ok;
+	stats.bytesIn = bytesIn;
+	stats.bytesOut = bytesOut;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
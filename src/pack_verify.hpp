@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "catalog_view.hpp"
+#include "pack_index.hpp"
+
+/**
+ *	The totals of a verification
+ */
+struct verify_stats
+{
+	uint64_t files = 0;		// Files that were checked
+	uint64_t ok = 0;		// Files that match the pack header
+	uint64_t notPacked = 0;	// Catalog entries without data in their pack
+	uint64_t bytesIn = 0;	// Bytes read from the packs
+	uint64_t bytesOut = 0;	// Bytes after inflating
+	double seconds = 0;
+};
+
+/**
+ *	A file whose data does not match its pack header
+ */
+struct verify_failure
+{
+	uint32_t crc;
+	std::string reason;
+};
+
+/*
+ * Checks the files in the packs of a client against their pack headers,
+ * without writing anything.
+ *
+ * Every file is inflated into memory, and its size and MD5 compared with
+ * the header; the MD5 of the stored data is checked as well where the
+ * header has one. The checksums are computed in batches, many files at
+ * once in the lanes of the vector registers. The files are cut into runs
+ * of neighbouring files in the same pack, which the worker threads take
+ * in turn, so that even a client with a few large packs keeps all cores
+ * busy.
+ */
+class pack_verifier {
+
+	const catalog_view& catalog;
+	const pack_index& locations;
+	std::string baseDir;
+
+	std::vector<verify_failure> failed;
+
+public:
+	bool verbose = false;
+
+	pack_verifier(const catalog_view& catalog, const pack_index& locations, const std::string& baseDir);
+
+	// Checks all files in the index on `threads` threads (0 for all cores)
+	verify_stats run(unsigned threads);
+
+	// The files that failed in the last run, by CRC
+	const std::vector<verify_failure>& failures() const { return failed; }
+};
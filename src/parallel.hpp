@@ -0,0 +1,51 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace parallel
+{
+	/**
+	 *	The number of worker threads to use when none was requested
+	 */
+	inline unsigned default_threads()
+	{
+		unsigned count = std::thread::hardware_concurrency();
+		return count > 0 ? count : 1;
+	}
+
+	/**
+	 *	Calls `fn(index, worker)` for every index in [0, count) on up to
+	 *	`threads` threads. Indices are handed out one by one, so uneven
+	 *	items balance out. The calling thread works as worker 0.
+	 */
+	template<typename F>
+	void for_each(std::size_t count, unsigned threads, F fn)
+	{
+		if (threads == 0) threads = default_threads();
+		if (threads > count) threads = (unsigned) count;
+
+		std::atomic<std::size_t> next(0);
+		auto work = [&next, count, &fn](unsigned worker)
+		{
+			for (std::size_t i = next++; i < count; i = next++)
+			{
+				fn(i, worker);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned t = 1; t < threads; t++)
+		{
+			pool.emplace_back(work, t);
+		}
+		work(0);
+
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+	}
+}
@@ -4,9 +4,13 @@
 
 #include <sstream>
 #include <iomanip>
+#include <fstream>
+#include <map>
 
 #include "zlib_stream.hpp"
 #include "sd0_stream.hpp"
+#include "prefetch_stream.hpp"
+#include "stage_stats.hpp"
 
 #include "transform.hpp"
 
@@ -22,6 +26,25 @@ int main_pipe(int argc, char** argv) {
 	OutputStage* opipe = new InitialOutputStage();
 	TransformStage* tpipe = nullptr;
 	ManageStage* mpipe = nullptr;
+	sd0_options sd0;
+	prefetch_options prefetch;
+	const char* outputDir = nullptr;
+	const char* statsFile = nullptr;
+	ClientExtractorStage* extractor = nullptr;
+	bool tee = false;
+	std::vector<TransformStage*> branches;
+
+	/* With --tee, every transform becomes a branch of one tee stage */
+	auto addTransform = [&](TransformStage* transform) {
+		if (tee) branches.push_back(transform);
+		else tpipe = transform;
+		part = 1;
+	};
+	bool inflatesSd0 = false;
+	bool compressesSd0 = false;
+	unsigned workers = 1;
+	bool workersSet = false;
+	bool sd0Threads = false;
 
 	std::stringstream pipe;
 	while (true) {
@@ -39,11 +62,22 @@ int main_pipe(int argc, char** argv) {
 			{"md5",      no_argument,				0, '5'},
 			{"checksd0", no_argument,				0, '0'},
 			{"client",   required_argument,			0, 'l'},
+			{"level",    required_argument,			0, 'L'},
+			{"block-size", required_argument,		0, 'B'},
+			{"threads",  required_argument,			0, 'j'},
+			{"sd0-threads", required_argument,		0, 'T'},
+			{"buffer-size", required_argument,		0, 'b'},
+			{"prefetch", optional_argument,			0, 'r'},
+			{"prefetch-size", required_argument,	0, 'R'},
+			{"output",   required_argument,			0, 'o'},
+			{"tee",      no_argument,				0, 't'},
+			{"copy",     no_argument,				0, 'C'},
+			{"stats",    required_argument,			0, 'J'},
 			{0, 0, 0, 0}
 		};
 
 		int option_index = 0;
-		c = getopt_long (argc, argv, "isf:cpm::v50lS", long_options, &option_index);
+		c = getopt_long (argc, argv, "isf:cpm::v50lSj:o:tC", long_options, &option_index);
 
 		if (c == -1) break;
 
@@ -60,7 +94,7 @@ int main_pipe(int argc, char** argv) {
 	        case 'i':
 				if (part == 0) {
 					pipe << "Inflate >> ";
-					ipipe = new GenericInputStage(ipipe, &create_inflate_stream<1024>);
+					ipipe = new GenericInputStage(ipipe, &create_inflate_stream, "Inflate");
 				} else {
 					std::cerr << "Cannot add inflate stage to output!" << std::endl;
 					exit(2);
@@ -70,7 +104,8 @@ int main_pipe(int argc, char** argv) {
 	        case 's':
 	        	if (part == 0) {
 					pipe << "SD0 >> ";
-					ipipe = new GenericInputStage(ipipe, &create_sd0_stream<1024>);
+					ipipe = new GenericInputStage(ipipe, &create_sd0_stream, "SD0");
+					inflatesSd0 = true;
 				} else {
 					std::cerr << "Cannot add SD0 stage to output!" << std::endl;
 					exit(2);
@@ -80,7 +115,73 @@ int main_pipe(int argc, char** argv) {
 			case 'S':
 	        	part = 1;
 				pipe << "Compress SD0 >> ";
-				opipe = new GenericOutputStage(opipe, &create_sd0_ostream<1024>);
+				opipe = new SD0OutputStage(opipe, &sd0);
+				compressesSd0 = true;
+				break;
+
+			case 'L':
+				sd0.level = std::stoi(optarg);
+				break;
+
+			case 'B':
+				sd0.blockSize = std::stoul(optarg);
+				break;
+
+			case 'j':
+				workers = std::stoul(optarg);
+				workersSet = true;
+				break;
+
+			case 'T':
+				sd0.threads = std::stoul(optarg);
+				sd0Threads = true;
+				break;
+
+			case 'b':
+				stream_buffer_size() = std::stoul(optarg);
+				break;
+
+			case 'r':
+				if (part == 0) {
+					pipe << "Prefetch >> ";
+					if (optarg) prefetch.depth = std::stoul(optarg);
+					ipipe = new PrefetchInputStage(ipipe, &prefetch);
+				} else {
+					std::cerr << "Cannot add prefetch stage to output!" << std::endl;
+					exit(2);
+				}
+				break;
+
+			case 'R':
+				prefetch.bufferSize = std::stoul(optarg);
+				break;
+
+			case 'o':
+				outputDir = optarg;
+				break;
+
+			case 'J':
+				statsFile = optarg;
+				break;
+
+			case 't':
+				if (part == 0) {
+					pipe << "Tee >> ";
+					tee = true;
+				} else {
+					std::cerr << "Cannot add tee to output!" << std::endl;
+					exit(2);
+				}
+				break;
+
+			case 'C':
+				if (part == 0 || tee) {
+					pipe << "Copy >> ";
+					addTransform(new NoTransformStage());
+				} else {
+					std::cerr << "Cannot add Copy transform to output!" << std::endl;
+					exit(2);
+				}
 				break;
 
 	        case 'f':
@@ -88,16 +189,16 @@ int main_pipe(int argc, char** argv) {
 					pipe << "File(" << optarg << ") >>";
 					ipipe = new DumpInputStage(ipipe, std::string(optarg));
 				} else {
-					std::cerr << "Output to file is not implemented yet!" << std::endl;
+					/* The files are the sink, so this stage goes last whenever it was given */
+					outputDir = optarg;
 				}
 
 				break;
 
 	        case 'c':
-	        	if (part == 0) {
+	        	if (part == 0 || tee) {
 					pipe << "Config >> ";
-					tpipe = new ConfigTransformStage();
-					part = 1;
+					addTransform(new ConfigTransformStage());
 				} else {
 					std::cerr << "Cannot add Config transform to output!" << std::endl;
 					exit(2);
@@ -105,10 +206,9 @@ int main_pipe(int argc, char** argv) {
 				break;
 
 			case '0':
-	        	if (part == 0) {
+	        	if (part == 0 || tee) {
 					pipe << "Check SD0 >> ";
-					tpipe = new SD0TransformStage();
-					part = 1;
+					addTransform(new SD0TransformStage());
 				} else {
 					std::cerr << "Cannot add SD0 Check transform to output!" << std::endl;
 					exit(2);
@@ -116,10 +216,9 @@ int main_pipe(int argc, char** argv) {
 				break;
 
 			case 'm':
-	        	if (part == 0) {
+	        	if (part == 0 || tee) {
 					pipe << "Manifest >> ";
-					tpipe = new ManifestTransformStage(optarg ? std::string(optarg) : "");
-					part = 1;
+					addTransform(new ManifestTransformStage(optarg ? std::string(optarg) : ""));
 				} else {
 					std::cerr << "Cannot add Manifest transform to output!" << std::endl;
 					exit(2);
@@ -127,10 +226,10 @@ int main_pipe(int argc, char** argv) {
 				break;
 
 			case 'l':
-	        	if (part == 0) {
+	        	if (part == 0 || tee) {
 					pipe << "ClientExtract >> ";
-					tpipe = new ClientExtractorStage(optarg ? std::string(optarg) : "");
-					part = 1;
+					extractor = new ClientExtractorStage(optarg ? std::string(optarg) : "");
+					addTransform(extractor);
 				} else {
 					std::cerr << "Cannot add ClientExtract transform to output!" << std::endl;
 					exit(2);
@@ -138,10 +237,9 @@ int main_pipe(int argc, char** argv) {
 				break;
 
 			case 'p':
-	        	if (part == 0) {
+	        	if (part == 0 || tee) {
 					pipe << "PackIndex >> ";
-					tpipe = new PackIndexTransformStage();
-					part = 1;
+					addTransform(new PackIndexTransformStage());
 				} else {
 					std::cerr << "Cannot add pack index transform to output!" << std::endl;
 					exit(2);
@@ -149,10 +247,9 @@ int main_pipe(int argc, char** argv) {
 				break;
 
 			case '5':
-				if (part == 0) {
+				if (part == 0 || tee) {
 					pipe << "MD5 >> ";
-					tpipe = new MD5TransformStage();
-					part = 1;
+					addTransform(new MD5TransformStage());
 				} else {
 					std::cerr << "Cannot add MD5 transform to output!" << std::endl;
 					exit(2);
@@ -172,7 +269,13 @@ int main_pipe(int argc, char** argv) {
 	    }
 	}
 
-	pipe << "Standard Out";
+	FileOutputStage* fileOutput = nullptr;
+	if (outputDir != nullptr) {
+		opipe = fileOutput = new FileOutputStage(opipe, outputDir, inflatesSd0 ? ".sd0" : "", compressesSd0 ? ".sd0" : "");
+		pipe << "Files(" << outputDir << ")";
+	} else {
+		pipe << "Standard Out";
+	}
 
 	if (verbose_flag) std::cout << std::setw(10) << "Pipeline" << ": " << pipe.str() << std::endl;
 
@@ -185,18 +288,76 @@ int main_pipe(int argc, char** argv) {
 	}
 	if (verbose_flag) std::cout << std::string(70, '-') << std::endl;
 
+	/* Outputs are named after the input without its directory, so two inputs must not share a name */
+	if (fileOutput != nullptr) {
+		std::map<std::string, std::string> outputs;
+		for (const std::string& file : files) {
+			auto found = outputs.emplace(fileOutput->outputPath(file), file);
+			if (!found.second) {
+				std::cerr << "Both '" << found.first->second << "' and '" << file << "' would be written to '" << found.first->first << "'!" << std::endl;
+				exit(2);
+			}
+		}
+	}
+
+	if (branches.size() == 1) {
+		tpipe = branches[0];
+	} else if (branches.size() > 1) {
+		tpipe = new TeeTransformStage(branches);
+	}
+
 	if (tpipe == nullptr) {
 		tpipe = new NoTransformStage();
 	}
 
+	/* Files are spread over the workers, a single input over the compressor threads */
+	if (workersSet && !sd0Threads) {
+		sd0.threads = files.size() > 1 ? 1 : workers;
+	}
+	if (workersSet && extractor != nullptr) {
+		extractor->threads = files.size() > 1 ? 1 : workers;
+	}
+
+	/* Every stage gets a meter on its links, so that the reports show the slowest */
+	pipeline_stats* stats = nullptr;
+	MeteredTransformStage* metered = nullptr;
+	if (verbose_flag || statsFile != nullptr) {
+		stats = new pipeline_stats();
+		ipipe = ipipe->instrument(*stats);
+		tpipe = metered = new MeteredTransformStage(tpipe, stats->add(tpipe->name()));
+		opipe = opipe->instrument(*stats);
+		if (outputDir == nullptr) {
+			opipe = new MeteredOutputStage(opipe, stats->link(true));
+			stats->add("Standard Out");
+		}
+	}
+
 	if (tpipe != nullptr) {
-		mpipe = new TransformManageStage(tpipe);
+		/* Reports only go to standard out when the data goes to files */
+		mpipe = new TransformManageStage(tpipe, workers, outputDir != nullptr ? &std::cout : &std::cerr);
 	}
 
 	if (mpipe != nullptr) {
 		mpipe->run(ipipe, opipe, files);
 	}
 
+	/* Output stages may still be writing in the background */
+	delete opipe;
+	delete ipipe;
+
+	if (stats != nullptr) {
+		if (verbose_flag) stats->print_table(std::cerr);
+		if (statsFile != nullptr && std::string(statsFile) == "-") {
+			stats->print_json(std::cout);
+		} else if (statsFile != nullptr) {
+			std::ofstream report(statsFile);
+			stats->print_json(report);
+			if (!report) std::cerr << "Could not write '" << statsFile << "'" << std::endl;
+		}
+		delete metered;
+		delete stats;
+	}
+
 	if (verbose_flag) std::cout << std::string(70, '-') << std::endl;
 	return 0;
 }
@@ -1,7 +1,19 @@
 #include "pipeline.hpp"
 
 #include <fstream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <sys/stat.h>
 #include "stream.hpp"
+#include "sd0_stream.hpp"
+#include "parallel.hpp"
+#include "prefetch_stream.hpp"
+#include "file_writer.hpp"
+#include "stage_stats.hpp"
+#include "sd0_index.hpp"
 
 extern int verbose_flag;
 
@@ -9,6 +21,12 @@ void InputStage::cleanup() {
 	if (wrapped != nullptr) wrapped->cleanup();
 }
 
+InputStage* InputStage::instrument(pipeline_stats& stats) {
+	if (wrapped != nullptr) wrapped = wrapped->instrument(stats);
+	stats.add(name());
+	return new MeteredInputStage(this, stats.link(false));
+}
+
 InputStage::~InputStage() {
 	if (wrapped != nullptr) delete wrapped;
 }
@@ -17,22 +35,34 @@ std::istream* InitialInputStage::getStream(std::istream* source) {
 	return source;
 }
 
+InputStage* InitialInputStage::clone() const {
+	return new InitialInputStage();
+}
+
+std::string InitialInputStage::name() const {
+	return "Read";
+}
+
 DumpInputStage::DumpInputStage(InputStage* wrapped, std::string filename) : filename(filename)
 {
 	this->wrapped = wrapped;
 }
 
 std::istream* DumpInputStage::getStream(std::istream* source) {
-	std::cerr << "1" << std::endl;
 	std::istream* in = wrapped->getStream(source);
-	std::cerr << "2" << std::endl;
-	std::streambuf *buf = new dump_istreambuf<1024>(in, filename);
-	std::cerr << "3" << std::endl;
+	std::streambuf *buf = new dump_istreambuf(in, filename);
 	contained = new closebuf_istream(buf);
-	std::cerr << "4" << std::endl;
 	return contained;
 }
 
+InputStage* DumpInputStage::clone() const {
+	return new DumpInputStage(wrapped->clone(), filename);
+}
+
+std::string DumpInputStage::name() const {
+	return "File(" + filename + ")";
+}
+
 void DumpInputStage::cleanup() {
 	if (wrapped != nullptr) wrapped -> cleanup();
 	if (contained != nullptr) {
@@ -45,10 +75,18 @@ std::istream* GenericInputStage::getStream(std::istream* source) {
 	return contained = construct(wrapped->getStream(source));
 }
 
-GenericInputStage::GenericInputStage(InputStage* wrapped, std::istream* (*construct)(std::istream* src)) : construct(construct) {
+GenericInputStage::GenericInputStage(InputStage* wrapped, std::istream* (*construct)(std::istream* src), std::string label) : construct(construct), label(label) {
 	this->wrapped = wrapped;
 }
 
+InputStage* GenericInputStage::clone() const {
+	return new GenericInputStage(wrapped->clone(), construct, label);
+}
+
+std::string GenericInputStage::name() const {
+	return label;
+}
+
 void GenericInputStage::cleanup() {
 	if (wrapped != nullptr) wrapped -> cleanup();
 	if (contained != nullptr) {
@@ -57,26 +95,111 @@ void GenericInputStage::cleanup() {
 	}
 }
 
+PrefetchInputStage::PrefetchInputStage(InputStage* wrapped, const prefetch_options* options) : options(options) {
+	this->wrapped = wrapped;
+}
+
+std::istream* PrefetchInputStage::getStream(std::istream* source) {
+	buffer = new prefetch_istreambuf(wrapped->getStream(source), *options);
+	return contained = new closebuf_istream(buffer);
+}
+
+InputStage* PrefetchInputStage::clone() const {
+	return new PrefetchInputStage(wrapped->clone(), options);
+}
+
+std::string PrefetchInputStage::name() const {
+	return "Prefetch";
+}
+
+void PrefetchInputStage::cleanup() {
+	/* The reader has to stop before the streams below it go away */
+	if (contained != nullptr) {
+		if (verbose_flag) {
+			prefetch_stats stats = buffer->stats();
+			std::cerr << "Prefetch: " << (stats.bytes >> 10) << " KiB in " << stats.buffers << " buffers, waited "
+			          << (stats.consumerWait / 1000000) << " ms for input, "
+			          << (stats.readerWait / 1000000) << " ms for the consumer" << std::endl;
+		}
+		delete contained;
+		contained = nullptr;
+		buffer = nullptr;
+	}
+	if (wrapped != nullptr) wrapped -> cleanup();
+}
+
+MeteredInputStage::MeteredInputStage(InputStage* wrapped, stage_link* link) : link(link) {
+	this->wrapped = wrapped;
+}
+
+std::istream* MeteredInputStage::getStream(std::istream* source) {
+	return contained = new closebuf_istream(new metered_istreambuf(wrapped->getStream(source), link));
+}
+
+InputStage* MeteredInputStage::clone() const {
+	return new MeteredInputStage(wrapped->clone(), link);
+}
+
+std::string MeteredInputStage::name() const {
+	return "Meter";
+}
+
+void MeteredInputStage::cleanup() {
+	if (contained != nullptr) {
+		delete contained;
+		contained = nullptr;
+	}
+	if (wrapped != nullptr) wrapped -> cleanup();
+}
+
 void OutputStage::cleanup() {
 	if (wrapped != nullptr) wrapped -> cleanup();
 }
 
+OutputStage* OutputStage::instrument(pipeline_stats& stats) {
+	/* The meter goes between this stage and the ones writing to it */
+	if (wrapped != nullptr) wrapped = wrapped->instrument(stats);
+	wrapped = new MeteredOutputStage(wrapped, stats.link(true));
+	stats.add(name());
+	return this;
+}
+
 OutputStage::~OutputStage() {
 	if (wrapped != nullptr) delete wrapped;	
 }
 
-std::ostream* InitialOutputStage::getStream(std::ostream* source, std::string name) {
+std::ostream* InitialOutputStage::getStream(std::ostream* source, std::string) {
 	return source;
 }
 
+OutputStage* InitialOutputStage::clone() const {
+	return new InitialOutputStage();
+}
+
+std::string InitialOutputStage::name() const {
+	return "Initial";
+}
+
+OutputStage* InitialOutputStage::instrument(pipeline_stats&) {
+	return this;
+}
+
 std::ostream* GenericOutputStage::getStream(std::ostream* source, std::string name) {
-	return wrapped->getStream(construct(source), name);
+	return wrapped->getStream(contained = construct(source), name);
 }
 
-GenericOutputStage::GenericOutputStage(OutputStage* wrapped, std::ostream* (*construct)(std::ostream* sink)) : construct(construct) {
+GenericOutputStage::GenericOutputStage(OutputStage* wrapped, std::ostream* (*construct)(std::ostream* sink), std::string label) : construct(construct), label(label) {
 	this->wrapped = wrapped;
 }
 
+OutputStage* GenericOutputStage::clone() const {
+	return new GenericOutputStage(wrapped->clone(), construct, label);
+}
+
+std::string GenericOutputStage::name() const {
+	return label;
+}
+
 void GenericOutputStage::cleanup() {
 	if (wrapped != nullptr) wrapped -> cleanup();
 	if (contained != nullptr) {
@@ -85,12 +208,168 @@ void GenericOutputStage::cleanup() {
 	}
 }
 
-TransformManageStage::TransformManageStage(TransformStage* transform) : transform(transform) {}
+SD0OutputStage::SD0OutputStage(OutputStage* wrapped, const sd0_options* options) : options(options) {
+	this->wrapped = wrapped;
+}
+
+std::ostream* SD0OutputStage::getStream(std::ostream* source, std::string name) {
+	return wrapped->getStream(contained = create_sd0_ostream(source, *options), name);
+}
+
+OutputStage* SD0OutputStage::clone() const {
+	return new SD0OutputStage(wrapped->clone(), options);
+}
+
+std::string SD0OutputStage::name() const {
+	return "Compress SD0";
+}
+
+void SD0OutputStage::cleanup() {
+	if (wrapped != nullptr) wrapped -> cleanup();
+	if (contained != nullptr) {
+		delete contained;
+		contained = nullptr;
+	}
+}
+
+FileOutputStage::FileOutputStage(OutputStage* wrapped, std::string directory, std::string removeSuffix, std::string addSuffix)
+	: directory(directory), removeSuffix(removeSuffix), addSuffix(addSuffix) {
+	this->wrapped = wrapped;
+	if (!this->directory.empty() && this->directory.back() != '/') this->directory += '/';
+}
+
+FileOutputStage::~FileOutputStage() {
+	if (writer != nullptr) {
+		uint64_t failures = writer->wait();
+		if (failures > 0) std::cerr << "Could not write " << failures << " times!" << std::endl;
+		delete writer;
+	}
+}
+
+std::ostream* FileOutputStage::getStream(std::ostream*, std::string name) {
+	if (writer == nullptr) writer = new file_writer();
+
+	std::string path = outputPath(name);
+	uint64_t size = expectedSize(name);
+
+	int fd = writer->open(path, size);
+	if (fd < 0) {
+		/* Without a buffer, the stream fails every write */
+		std::cerr << "Could not open '" << path << "' for writing!" << std::endl;
+		contained = new std::ostream(nullptr);
+	} else {
+		if (verbose_flag) std::cerr << "Writing: " << path << std::endl;
+		contained = new closebuf_ostream(new file_writer_streambuf(writer, fd, size));
+	}
+
+	return wrapped->getStream(contained, name);
+}
+
+std::string FileOutputStage::outputPath(const std::string& name) const {
+	std::string file = name.substr(name.find_last_of('/') + 1);
+	if (!removeSuffix.empty() && file.size() > removeSuffix.size()
+		&& file.compare(file.size() - removeSuffix.size(), removeSuffix.size(), removeSuffix) == 0) {
+		file.resize(file.size() - removeSuffix.size());
+	}
+	return directory + file + addSuffix;
+}
+
+uint64_t FileOutputStage::expectedSize(const std::string& name) const {
+	/* Only a hint for reserving the space, the file is cut to what was written in the end */
+	if (addSuffix.empty() && removeSuffix == ".sd0") {
+		sd0_index index;
+		if (index.open(sd0_index::sidecar_path(name)) && index.fresh(name)) return index.uncompressed_size();
+	} else if (addSuffix.empty() && removeSuffix.empty()) {
+		struct stat st;
+		if (stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode)) return st.st_size;
+	}
+	return 0;
+}
+
+OutputStage* FileOutputStage::clone() const {
+	return new FileOutputStage(wrapped->clone(), directory, removeSuffix, addSuffix);
+}
+
+std::string FileOutputStage::name() const {
+	return "Files(" + directory + ")";
+}
+
+void FileOutputStage::cleanup() {
+	/* The stages in front write their last data on cleanup */
+	if (wrapped != nullptr) wrapped -> cleanup();
+	if (contained != nullptr) {
+		delete contained;
+		contained = nullptr;
+	}
+}
+
+MeteredOutputStage::MeteredOutputStage(OutputStage* wrapped, stage_link* link) : link(link) {
+	this->wrapped = wrapped;
+}
+
+std::ostream* MeteredOutputStage::getStream(std::ostream* sink, std::string name) {
+	return wrapped->getStream(contained = new closebuf_ostream(new metered_ostreambuf(sink, link)), name);
+}
+
+OutputStage* MeteredOutputStage::clone() const {
+	return new MeteredOutputStage(wrapped->clone(), link);
+}
+
+std::string MeteredOutputStage::name() const {
+	return "Meter";
+}
+
+void MeteredOutputStage::cleanup() {
+	/* The stages in front write their last data on cleanup */
+	if (wrapped != nullptr) wrapped -> cleanup();
+	if (contained != nullptr) {
+		delete contained;
+		contained = nullptr;
+	}
+}
+
+MeteredTransformStage::MeteredTransformStage(TransformStage* transform, stage_link* link) : transform(transform), link(link) {}
+
+void MeteredTransformStage::run(std::istream* source, std::ostream* sink) {
+	stage_clock::time_point start = stage_clock::now();
+	transform->run(source, sink);
+	link->add(0, stage_clock::now() - start);
+}
+
+std::string MeteredTransformStage::name() const {
+	return transform->name();
+}
+
+static thread_local std::ostream* currentReport = nullptr;
+
+std::ostream& report_stream()
+{
+	return currentReport != nullptr ? *currentReport : std::cerr;
+}
+
+ReportScope::ReportScope(std::ostream* stream) : previous(currentReport)
+{
+	currentReport = stream;
+}
+
+ReportScope::~ReportScope()
+{
+	currentReport = previous;
+}
+
+TransformManageStage::TransformManageStage(TransformStage* transform, unsigned threads, std::ostream* report)
+	: transform(transform), threads(threads), report(report) {}
 
 void TransformManageStage::run(InputStage* input, OutputStage* output, std::vector<std::string> files)
 {
+	if (threads != 1 && files.size() > 1) {
+		runParallel(input, output, files);
+		return;
+	}
+
 	bool from_stdin = files.empty();
 	bool first = true;
+	ReportScope scope(report);
 
 	if (from_stdin) {
 		std::istream* in = input->getStream(&std::cin);
@@ -116,4 +395,60 @@ void TransformManageStage::run(InputStage* input, OutputStage* output, std::vect
 			if (verbose_flag) std::cout << "---------------------------------------------------------------------";
 		}
 	}
-}
\ No newline at end of file
+}
+void TransformManageStage::runParallel(InputStage* input, OutputStage* output, std::vector<std::string>& files)
+{
+	unsigned workers = threads == 0 ? parallel::default_threads() : threads;
+	workers = std::min<std::size_t>(workers, files.size());
+
+	/* The stages keep the streams of the current file, so every worker needs its own chains */
+	std::vector<std::unique_ptr<InputStage>> inputs;
+	std::vector<std::unique_ptr<OutputStage>> outputs;
+	for (unsigned w = 0; w < workers; w++) {
+		inputs.emplace_back(input->clone());
+		outputs.emplace_back(output->clone());
+	}
+
+	/* Results and reports are printed in the order of the files, and only a few may wait for their turn */
+	std::vector<std::string> results(files.size());
+	std::vector<std::string> reports(files.size());
+	std::vector<bool> done(files.size(), false);
+	std::size_t printed = 0;
+	std::size_t window = 2 * workers;
+	std::mutex mutex;
+	std::condition_variable turn;
+
+	parallel::for_each(files.size(), workers, [&](std::size_t i, unsigned worker) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			turn.wait(lock, [&] { return i < printed + window; });
+		}
+
+		std::ostringstream buffer, reportBuffer;
+		{
+			ReportScope scope(&reportBuffer);
+			std::ifstream infile(files[i], std::ios::binary);
+			std::istream* in = inputs[worker]->getStream(&infile);
+			std::ostream* out = outputs[worker]->getStream(&buffer, files[i]);
+			transform->run(in, out);
+			out->flush();
+			inputs[worker]->cleanup();
+			outputs[worker]->cleanup();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		results[i] = buffer.str();
+		reports[i] = reportBuffer.str();
+		done[i] = true;
+		while (printed < files.size() && done[printed]) {
+			std::cout.write(results[printed].data(), results[printed].size());
+			report->write(reports[printed].data(), reports[printed].size());
+			std::string().swap(results[printed]);
+			std::string().swap(reports[printed]);
+			printed++;
+		}
+		std::cout.flush();
+		report->flush();
+		turn.notify_all();
+	});
+}
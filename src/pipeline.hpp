@@ -1,8 +1,16 @@
 #pragma once
+#include <stdint.h>
 #include <iostream>
 #include <vector>
 #include <string>
 
+struct sd0_options;
+struct prefetch_options;
+class prefetch_istreambuf;
+class file_writer;
+class pipeline_stats;
+struct stage_link;
+
 class InputStage {
 protected:
 	// The wrapped predecessor to this stage
@@ -15,6 +23,15 @@ public:
 	// Clean up the Input if necessary
 	virtual void cleanup();
 
+	// A new chain with the same settings, for use on another thread
+	virtual InputStage* clone() const = 0;
+
+	// The name of this stage in reports
+	virtual std::string name() const = 0;
+
+	// Meters the output of every stage of the chain, returns the new end of the chain
+	virtual InputStage* instrument(pipeline_stats& stats);
+
 	// Delete this stage
 	virtual ~InputStage();
 };
@@ -24,6 +41,9 @@ class InitialInputStage : public InputStage {
 public:
 	// Return the parameter
 	std::istream* getStream(std::istream* source);
+
+	InputStage* clone() const;
+	std::string name() const;
 };
 
 class DumpInputStage : public InputStage {
@@ -39,6 +59,9 @@ public:
 	
 	// Return the parameter
 	std::istream* getStream(std::istream* source);
+
+	InputStage* clone() const;
+	std::string name() const;
 };
 
 class GenericInputStage : public InputStage {
@@ -47,16 +70,63 @@ protected:
 	// The function pointer to create this stage stream
 	std::istream* (*construct)(std::istream* src);
 	std::istream* contained = nullptr;
+	std::string label;
 
 public:
 	// Create the stage
-	GenericInputStage(InputStage* wrapped, std::istream* (*construct)(std::istream* src));
+	GenericInputStage(InputStage* wrapped, std::istream* (*construct)(std::istream* src), std::string label);
 
 	// Cleaning things up
 	void cleanup();
 
 	// Calling this construct function
 	std::istream* getStream(std::istream* source);
+
+	InputStage* clone() const;
+	std::string name() const;
+};
+
+class PrefetchInputStage : public InputStage {
+
+protected:
+	// The read-ahead settings, owned by the caller
+	const prefetch_options* options;
+	prefetch_istreambuf* buffer = nullptr;
+	std::istream* contained = nullptr;
+
+public:
+	// Create the stage
+	PrefetchInputStage(InputStage* wrapped, const prefetch_options* options);
+
+	// Stops the reader, and reports its waits when verbose
+	void cleanup();
+
+	// Reads the stream of the predecessor ahead on another thread
+	std::istream* getStream(std::istream* source);
+
+	InputStage* clone() const;
+	std::string name() const;
+};
+
+class MeteredInputStage : public InputStage {
+
+protected:
+	// Where the data read from the predecessor is counted, owned by the stats
+	stage_link* link;
+	std::istream* contained = nullptr;
+
+public:
+	// Create the stage
+	MeteredInputStage(InputStage* wrapped, stage_link* link);
+
+	// Cleaning things up
+	void cleanup();
+
+	// Counts the reads from the stream of the predecessor
+	std::istream* getStream(std::istream* source);
+
+	InputStage* clone() const;
+	std::string name() const;
 };
 
 class OutputStage {
@@ -73,6 +143,15 @@ public:
 	// Clean up the input if necessary
 	virtual void cleanup();
 
+	// A new chain with the same settings, for use on another thread
+	virtual OutputStage* clone() const = 0;
+
+	// The name of this stage in reports
+	virtual std::string name() const = 0;
+
+	// Meters the input of every stage of the chain, returns the new end of the chain
+	virtual OutputStage* instrument(pipeline_stats& stats);
+
 	// Deletes this stage
 	virtual ~OutputStage();
 
@@ -83,6 +162,12 @@ class InitialOutputStage : public OutputStage {
 public:
 	// Return through wrapped
 	std::ostream* getStream(std::ostream* sink, std::string name);
+
+	OutputStage* clone() const;
+	std::string name() const;
+
+	// Passes the data on unchanged, so there is nothing to meter
+	OutputStage* instrument(pipeline_stats& stats);
 };
 
 class GenericOutputStage : public OutputStage {
@@ -91,16 +176,96 @@ protected:
 	// The function pointer to create this stage stream
 	std::ostream* (*construct)(std::ostream* sink);
 	std::ostream* contained = nullptr;
+	std::string label;
 
 public:
 	// Constructor with the predecessor
-	GenericOutputStage(OutputStage* wrapped, std::ostream* (*construct)(std::ostream* sink));
+	GenericOutputStage(OutputStage* wrapped, std::ostream* (*construct)(std::ostream* sink), std::string label);
 
 	// Cleaning things up
 	void cleanup();
 
 	// Calling the construct method
 	std::ostream* getStream(std::ostream* sink, std::string name);
+
+	OutputStage* clone() const;
+	std::string name() const;
+};
+
+class SD0OutputStage : public OutputStage {
+
+protected:
+	// The compression settings, owned by the caller
+	const sd0_options* options;
+	std::ostream* contained = nullptr;
+
+public:
+	// Constructor with the predecessor
+	SD0OutputStage(OutputStage* wrapped, const sd0_options* options);
+
+	// Writes the last block
+	void cleanup();
+
+	// Wraps the sink in a parallel sd0 compressor
+	std::ostream* getStream(std::ostream* sink, std::string name);
+
+	OutputStage* clone() const;
+	std::string name() const;
+};
+
+class FileOutputStage : public OutputStage {
+
+protected:
+	// Where the files go, and how their names change
+	std::string directory;
+	std::string removeSuffix;
+	std::string addSuffix;
+
+	file_writer* writer = nullptr;
+	std::ostream* contained = nullptr;
+
+public:
+	// Constructor with the predecessor
+	FileOutputStage(OutputStage* wrapped, std::string directory, std::string removeSuffix, std::string addSuffix);
+
+	// Waits for the last writes
+	~FileOutputStage();
+
+	// Queues the rest of the file and closing it
+	void cleanup();
+
+	// Replaces the sink with a file named after the input, written on a background thread
+	std::ostream* getStream(std::ostream* sink, std::string name);
+
+	// The file that the output for an input goes to
+	std::string outputPath(const std::string& name) const;
+
+	// The likely size of the output for an input, or 0 if it is not known
+	uint64_t expectedSize(const std::string& name) const;
+
+	OutputStage* clone() const;
+	std::string name() const;
+};
+
+class MeteredOutputStage : public OutputStage {
+
+protected:
+	// Where the data written to the sink is counted, owned by the stats
+	stage_link* link;
+	std::ostream* contained = nullptr;
+
+public:
+	// Constructor with the predecessor
+	MeteredOutputStage(OutputStage* wrapped, stage_link* link);
+
+	// Writes what is left
+	void cleanup();
+
+	// Counts the writes to the sink
+	std::ostream* getStream(std::ostream* sink, std::string name);
+
+	OutputStage* clone() const;
+	std::string name() const;
 };
 
 class ManageStage {
@@ -110,18 +275,57 @@ public:
 	virtual void run(InputStage* input, OutputStage* output, std::vector<std::string> files) = 0;
 };
 
+// The stream that reports besides the output of a transform go to, on the calling thread
+std::ostream& report_stream();
+
+/*
+ * Points the report stream of the current thread somewhere else for as
+ * long as it exists.
+ */
+class ReportScope {
+	std::ostream* previous;
+public:
+	ReportScope(std::ostream* stream);
+	~ReportScope();
+};
+
 class TransformStage {
 
 public:
 	// The main function for this transformation
 	virtual void run(std::istream* source, std::ostream* sink) = 0;
+
+	// The name of this stage in reports
+	virtual std::string name() const = 0;
+
+	virtual ~TransformStage() {}
+};
+
+class MeteredTransformStage : public TransformStage {
+	TransformStage* transform;
+	stage_link* link;
+
+public:
+	// Times the runs of a transformation, which stays owned by the caller
+	MeteredTransformStage(TransformStage* transform, stage_link* link);
+	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class TransformManageStage : public ManageStage {
 protected:
 	TransformStage* transform;
+
+	// The number of files processed at once (0 for all cores)
+	unsigned threads;
+
+	// Where the reports of the transform go, in the order of the files
+	std::ostream* report;
+
+	// Processes the files on worker threads, each with its own stage chains
+	void runParallel(InputStage* input, OutputStage* output, std::vector<std::string>& files);
 public:
-	// The transformation in this manage stage
-	TransformManageStage(TransformStage* transform);
+	// The transformation in this manage stage, which is shared by all workers
+	TransformManageStage(TransformStage* transform, unsigned threads = 1, std::ostream* report = &std::cerr);
 	void run(InputStage* input, OutputStage* output, std::vector<std::string> files);
 };
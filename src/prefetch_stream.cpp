@@ -0,0 +1,110 @@
+#include "prefetch_stream.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+typedef std::chrono::steady_clock prefetch_clock;
+
+static uint64_t nanoseconds_since(prefetch_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(prefetch_clock::now() - start).count();
+}
+
+prefetch_stats& prefetch_stats::operator+=(const prefetch_stats& other)
+{
+	bytes += other.bytes;
+	buffers += other.buffers;
+	consumerWait += other.consumerWait;
+	readerWait += other.readerWait;
+	return *this;
+}
+
+prefetch_istreambuf::prefetch_istreambuf(std::istream* input, const prefetch_options& options)
+	: input(input), ring(std::max(options.depth, 2u))
+{
+	for (slot& s : ring) s.data.resize(std::max<std::size_t>(options.bufferSize, 1));
+	setg(nullptr, nullptr, nullptr);
+	reader = std::thread(&prefetch_istreambuf::read, this);
+}
+
+prefetch_istreambuf::~prefetch_istreambuf()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	hasSpace.notify_all();
+	reader.join();
+}
+
+void prefetch_istreambuf::read()
+{
+	while (true)
+	{
+		slot* target;
+		{
+			/* The slot the consumer reads from stays taken until it asks for the next one */
+			std::unique_lock<std::mutex> lock(mutex);
+			prefetch_clock::time_point start = prefetch_clock::now();
+			hasSpace.wait(lock, [this] { return stopping || filled + (holding ? 1 : 0) < ring.size(); });
+			counters.readerWait += nanoseconds_since(start);
+			if (stopping) return;
+			target = &ring[tail];
+		}
+
+		input->read(target->data.data(), target->data.size());
+		target->length = input->gcount();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (target->length == 0)
+		{
+			ended = true;
+			hasData.notify_one();
+			return;
+		}
+
+		tail = (tail + 1) % ring.size();
+		filled++;
+		counters.bytes += target->length;
+		counters.buffers++;
+		hasData.notify_one();
+	}
+}
+
+prefetch_istreambuf::int_type prefetch_istreambuf::underflow()
+{
+	if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	/* Hand the slot that was read back to the reader */
+	if (holding)
+	{
+		holding = false;
+		hasSpace.notify_one();
+	}
+
+	prefetch_clock::time_point start = prefetch_clock::now();
+	hasData.wait(lock, [this] { return filled > 0 || ended; });
+	counters.consumerWait += nanoseconds_since(start);
+
+	if (filled == 0)
+	{
+		setg(nullptr, nullptr, nullptr);
+		return traits_type::eof();
+	}
+
+	slot& current = ring[head];
+	head = (head + 1) % ring.size();
+	filled--;
+	holding = true;
+
+	setg(current.data.data(), current.data.data(), current.data.data() + current.length);
+	return traits_type::to_int_type(*gptr());
+}
+
+prefetch_stats prefetch_istreambuf::stats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return counters;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define PREFETCH_DEPTH 4
+#define PREFETCH_BUFFER_SIZE (1 << 20)
+
+/**
+ *	The settings of a read-ahead stream
+ */
+struct prefetch_options
+{
+	unsigned depth = PREFETCH_DEPTH;				// The number of buffers in the ring
+	std::size_t bufferSize = PREFETCH_BUFFER_SIZE;
+};
+
+/**
+ *	What a read-ahead stream waited for. A consumer that waits a lot
+ *	is faster than the input, a reader that waits a lot is slower.
+ */
+struct prefetch_stats
+{
+	uint64_t bytes = 0;
+	uint64_t buffers = 0;
+	uint64_t consumerWait = 0;	// Nanoseconds the consumer waited for data
+	uint64_t readerWait = 0;	// Nanoseconds the reader waited for a free buffer
+
+	prefetch_stats& operator+=(const prefetch_stats& other);
+};
+
+/*
+ * Reads a stream ahead of its consumer on a background thread.
+ *
+ * The reader fills a ring of large buffers from the wrapped stream while
+ * the consumer works on the previous ones, so that reading the input
+ * overlaps with whatever the stages above do with it. The wrapped stream
+ * is only used by the reader thread.
+ */
+class prefetch_istreambuf : public std::streambuf {
+
+	struct slot
+	{
+		std::vector<char> data;
+		std::size_t length = 0;
+	};
+
+	std::istream* input;
+	std::vector<slot> ring;
+	std::size_t head = 0;		// The next slot the consumer takes
+	std::size_t tail = 0;		// The next slot the reader fills
+	std::size_t filled = 0;		// The number of slots with data
+	bool holding = false;		// Whether the consumer is reading from the slot before head
+	bool ended = false;
+	bool stopping = false;
+
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable hasData;
+	std::condition_variable hasSpace;
+
+	prefetch_stats counters;
+
+	void read();
+
+public:
+	prefetch_istreambuf(std::istream* input, const prefetch_options& options = prefetch_options());
+	~prefetch_istreambuf();
+
+	prefetch_istreambuf(const prefetch_istreambuf&) = delete;
+	prefetch_istreambuf& operator=(const prefetch_istreambuf&) = delete;
+
+	int_type underflow();
+
+	// What the stream waited for so far
+	prefetch_stats stats();
+};
@@ -0,0 +1,207 @@
+#include "sd0_codec.hpp"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+
+#include "parallel.hpp"
+
+const char SD0_MAGIC[SD0_MAGIC_SIZE] = {'s', 'd', '0', 1, -1};
+
+bool sd0_check_magic(const char* src, std::size_t srcLength)
+{
+	return srcLength >= SD0_MAGIC_SIZE && memcmp(src, SD0_MAGIC, SD0_MAGIC_SIZE) == 0;
+}
+
+sd0_decoder::sd0_decoder() : backend(create_codec("", SD0_DEFAULT_LEVEL))
+{
+}
+
+sd0_decoder::~sd0_decoder()
+{
+}
+
+int64_t sd0_decoder::decode(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+{
+	if (!backend || !sd0_check_magic(src, srcLength)) return -1;
+
+	const char* pos = src + SD0_MAGIC_SIZE;
+	const char* end = src + srcLength;
+	std::size_t written = 0;
+
+	while (end - pos >= 4)
+	{
+		uint32_t blockSize;
+		memcpy(&blockSize, pos, 4);
+		pos += 4;
+
+		if ((std::size_t) (end - pos) < blockSize) return -1;
+
+		int64_t have = decode_block(pos, blockSize, dst ? dst + written : nullptr, dstLength - written);
+		if (have < 0) return -1;
+
+		written += have;
+		pos += blockSize;
+	}
+
+	return written;
+}
+
+int64_t sd0_decoder::decode_block(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+{
+	if (!backend) return -1;
+
+	int64_t written = backend->inflate(src, srcLength, dst, dst ? dstLength : 0);
+	return written < 0 ? -1 : written;
+}
+
+bool sd0_decoder::decode_block(const char* src, std::size_t srcLength, std::vector<char>& out)
+{
+	if (!backend) return false;
+
+	/* Deflate can't do better than about 1:1032, which bounds the retries */
+	std::size_t written = out.size();
+	std::size_t limit = srcLength * 1032 + SD0_BLOCK_SIZE;
+	std::size_t room = SD0_BLOCK_SIZE;
+
+	while (true)
+	{
+		out.resize(written + room);
+
+		int64_t have = backend->inflate(src, srcLength, out.data() + written, room);
+		if (have >= 0)
+		{
+			out.resize(written + have);
+			return true;
+		}
+
+		if (have != CODEC_SHORT || room >= limit) break;
+		room *= 2;
+	}
+
+	out.resize(written);
+	return false;
+}
+
+sd0_encoder::sd0_encoder(int level) : backend(create_codec("", level))
+{
+}
+
+sd0_encoder::~sd0_encoder()
+{
+}
+
+bool sd0_encoder::encode_block(const char* src, std::size_t srcLength, std::vector<char>& out)
+{
+	if (!backend) return false;
+
+	/* The bound is large enough to finish in a single call */
+	out.resize(backend->deflate_bound(srcLength));
+
+	int64_t size = backend->deflate(src, srcLength, out.data(), out.size());
+	out.resize(size < 0 ? 0 : size);
+	return size >= 0;
+}
+
+bool sd0_scan(const char* src, std::size_t srcLength, std::vector<sd0_block>& blocks)
+{
+	blocks.clear();
+	if (!sd0_check_magic(src, srcLength)) return false;
+
+	std::size_t pos = SD0_MAGIC_SIZE;
+	while (srcLength - pos >= 4)
+	{
+		uint32_t blockSize;
+		memcpy(&blockSize, src + pos, 4);
+		pos += 4;
+
+		if (srcLength - pos < blockSize) return false;
+
+		blocks.push_back({pos, blockSize});
+		pos += blockSize;
+	}
+	return true;
+}
+
+/**
+ *	Inflates every block into its slot of SD0_BLOCK_SIZE bytes at dst, the
+ *	last one into what is left of dstLength. Returns false if any block
+ *	does not fill its slot exactly, that is if the blocks were not written
+ *	with the standard size.
+ */
+static bool decode_blocks(const char* src, const std::vector<sd0_block>& blocks, char* dst, std::size_t dstLength, unsigned threads)
+{
+	if (threads == 0) threads = parallel::default_threads();
+	threads = std::min<std::size_t>(threads, blocks.size());
+
+	std::vector<std::unique_ptr<sd0_decoder>> decoders(threads);
+	std::atomic<bool> ok(true);
+
+	parallel::for_each(blocks.size(), threads, [&](std::size_t i, unsigned worker)
+	{
+		if (!ok) return;
+		if (!decoders[worker]) decoders[worker].reset(new sd0_decoder());
+
+		std::size_t start = i * SD0_BLOCK_SIZE;
+		std::size_t length = std::min<std::size_t>(SD0_BLOCK_SIZE, dstLength - start);
+		if (decoders[worker]->decode_block(src + blocks[i].offset, blocks[i].size, dst + start, length) != (int64_t) length)
+		{
+			ok = false;
+		}
+	});
+
+	return ok;
+}
+
+int64_t sd0_decode_parallel(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength, unsigned threads)
+{
+	std::vector<sd0_block> blocks;
+	if (!sd0_scan(src, srcLength, blocks)) return -1;
+
+	/* With standard blocks, the output size fixes where every block goes */
+	std::size_t count = blocks.size();
+	if (threads != 1 && count > 1 && dstLength > (count - 1) * SD0_BLOCK_SIZE && dstLength <= count * SD0_BLOCK_SIZE)
+	{
+		if (decode_blocks(src, blocks, dst, dstLength, threads)) return dstLength;
+	}
+
+	sd0_decoder decoder;
+	return decoder.decode(src, srcLength, dst, dstLength);
+}
+
+bool sd0_decode_parallel(const char* src, std::size_t srcLength, std::vector<char>& out, unsigned threads)
+{
+	out.clear();
+
+	std::vector<sd0_block> blocks;
+	if (!sd0_scan(src, srcLength, blocks)) return false;
+
+	/* The last block is the only one of unknown size, so decode it first */
+	sd0_decoder decoder;
+	if (blocks.empty()) return true;
+
+	std::vector<char> last;
+	if (!decoder.decode_block(src + blocks.back().offset, blocks.back().size, last)) return false;
+
+	std::size_t count = blocks.size();
+	if (threads != 1 && count > 1 && !last.empty() && last.size() <= SD0_BLOCK_SIZE)
+	{
+		std::size_t head = (count - 1) * SD0_BLOCK_SIZE;
+		out.resize(head + last.size());
+
+		std::vector<sd0_block> rest(blocks.begin(), blocks.end() - 1);
+		if (decode_blocks(src, rest, out.data(), head, threads))
+		{
+			memcpy(out.data() + head, last.data(), last.size());
+			return true;
+		}
+		out.clear();
+	}
+
+	for (const sd0_block& block : blocks)
+	{
+		if (!decoder.decode_block(src + block.offset, block.size, out)) return false;
+	}
+	return true;
+}
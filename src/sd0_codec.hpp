@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "codec.hpp"
+
+#define SD0_MAGIC_SIZE 5
+#define SD0_BLOCK_SIZE 262144	// The uncompressed size of every block but the last
+#define SD0_DEFAULT_LEVEL 4		// The level of the files in the client
+
+/*
+ * Decoding of complete sd0 buffers.
+ *
+ * An sd0 file is the magic "sd0\x01\xff" followed by blocks, each a
+ * 32 bit length and that many bytes of an independent zlib stream.
+ * The blocks are inflated with the default codec.
+ */
+class sd0_decoder {
+
+	std::unique_ptr<codec> backend;
+
+public:
+	sd0_decoder();
+	~sd0_decoder();
+
+	sd0_decoder(const sd0_decoder&) = delete;
+	sd0_decoder& operator=(const sd0_decoder&) = delete;
+
+	// Decodes src into dst, returns the number of bytes written or -1 on error
+	int64_t decode(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength);
+
+	// Decodes a single block (without its length) into dst, returns the number of bytes written or -1 on error
+	int64_t decode_block(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength);
+
+	// Decodes a single block and appends it to out, growing it as needed
+	bool decode_block(const char* src, std::size_t srcLength, std::vector<char>& out);
+};
+
+/*
+ * Compression of single sd0 blocks with the default codec, which keeps
+ * its state between blocks instead of setting it up again.
+ */
+class sd0_encoder {
+
+	std::unique_ptr<codec> backend;
+
+public:
+	sd0_encoder(int level = SD0_DEFAULT_LEVEL);
+	~sd0_encoder();
+
+	sd0_encoder(const sd0_encoder&) = delete;
+	sd0_encoder& operator=(const sd0_encoder&) = delete;
+
+	// Compresses src into out (without the length), returns false on error
+	bool encode_block(const char* src, std::size_t srcLength, std::vector<char>& out);
+};
+
+/**
+ *	Where the zlib stream of one block is within an sd0 buffer
+ */
+struct sd0_block
+{
+	std::size_t offset;
+	uint32_t size;
+};
+
+// The magic at the start of every sd0 file
+extern const char SD0_MAGIC[SD0_MAGIC_SIZE];
+
+// Whether the buffer starts with the sd0 magic
+bool sd0_check_magic(const char* src, std::size_t srcLength);
+
+// Collects the blocks of an sd0 buffer from their length headers, returns false if it is malformed
+bool sd0_scan(const char* src, std::size_t srcLength, std::vector<sd0_block>& blocks);
+
+// Like sd0_decoder::decode, but inflates the blocks on up to `threads` threads (0 for all cores)
+int64_t sd0_decode_parallel(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength, unsigned threads);
+
+// Decodes an sd0 buffer of unknown uncompressed size into out on up to `threads` threads
+bool sd0_decode_parallel(const char* src, std::size_t srcLength, std::vector<char>& out, unsigned threads);
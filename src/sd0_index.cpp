@@ -0,0 +1,141 @@
+#include "sd0_index.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "sd0_codec.hpp"
+
+#define SD0_INDEX_MAGIC "SD0X"
+#define SD0_INDEX_VERSION 1
+
+static int64_t mtime_of(const struct stat& st)
+{
+	return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool sd0_index::build(std::istream& input)
+{
+	blocks.clear();
+	total = 0;
+
+	char magic[SD0_MAGIC_SIZE];
+	if (!input.read(magic, SD0_MAGIC_SIZE) || !sd0_check_magic(magic, SD0_MAGIC_SIZE)) return false;
+
+	sd0_decoder decoder;
+	std::vector<char> raw;
+	std::vector<char> data;
+
+	uint64_t offset = SD0_MAGIC_SIZE;
+	uint32_t size;
+	while (input.read((char*) &size, 4))
+	{
+		offset += 4;
+
+		raw.resize(size);
+		if (!input.read(raw.data(), size)) return false;
+
+		data.clear();
+		if (!decoder.decode_block(raw.data(), size, data)) return false;
+
+		blocks.push_back({offset, size, (uint32_t) data.size(), total});
+		offset += size;
+		total += data.size();
+	}
+
+	/* A partial length at the end is a truncated file */
+	return input.gcount() == 0;
+}
+
+bool sd0_index::build(const std::string& path)
+{
+	std::ifstream input(path, std::ios::binary);
+	struct stat st;
+	if (!input.is_open() || stat(path.c_str(), &st) != 0) return false;
+
+	fileSize = st.st_size;
+	fileMtime = mtime_of(st);
+	return build(input);
+}
+
+bool sd0_index::open(const std::string& sidecar)
+{
+	std::ifstream input(sidecar, std::ios::binary);
+	if (!input.is_open()) return false;
+
+	sd0_index_header header;
+	if (!input.read((char*) &header, sizeof(header))) return false;
+	if (memcmp(header.magic, SD0_INDEX_MAGIC, 4) != 0 || header.version != SD0_INDEX_VERSION) return false;
+
+	std::vector<sd0_index_entry> entries(header.blockCount);
+	if (!input.read((char*) entries.data(), entries.size() * sizeof(sd0_index_entry))) return false;
+
+	/* The blocks must follow each other without gaps */
+	uint64_t start = 0;
+	for (const sd0_index_entry& entry : entries)
+	{
+		if (entry.start != start) return false;
+		start += entry.length;
+	}
+
+	blocks.swap(entries);
+	total = start;
+	fileSize = header.fileSize;
+	fileMtime = header.fileMtime;
+	return true;
+}
+
+bool sd0_index::write(const std::string& sidecar) const
+{
+	sd0_index_header header;
+	memcpy(header.magic, SD0_INDEX_MAGIC, 4);
+	header.version = SD0_INDEX_VERSION;
+	header.blockCount = blocks.size();
+	header.reserved = 0;
+	header.fileSize = fileSize;
+	header.fileMtime = fileMtime;
+
+	std::ofstream out(sidecar, std::ios::binary);
+	if (!out.is_open()) return false;
+	out.write((const char*) &header, sizeof(header));
+	out.write((const char*) blocks.data(), blocks.size() * sizeof(sd0_index_entry));
+	return out.good();
+}
+
+bool sd0_index::fresh(const std::string& path) const
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	return fileSize == (uint64_t) st.st_size && fileMtime == mtime_of(st);
+}
+
+bool sd0_index::load(const std::string& path)
+{
+	std::string sidecar = sidecar_path(path);
+	if (open(sidecar) && fresh(path)) return true;
+	if (!build(path)) return false;
+
+	/* The directory may not be writable, the table is still good */
+	write(sidecar);
+	return true;
+}
+
+int32_t sd0_index::find(uint64_t position) const
+{
+	if (position >= total) return -1;
+
+	std::vector<sd0_index_entry>::const_iterator it = std::upper_bound(blocks.begin(), blocks.end(), position,
+		[](uint64_t pos, const sd0_index_entry& entry) { return pos < entry.start; });
+	return (it - blocks.begin()) - 1;
+}
+
+std::string sd0_index::sidecar_path(const std::string& path)
+{
+	std::string::size_type len = path.size();
+	if (len >= 4 && path.compare(len - 4, 4, ".sd0") == 0)
+	{
+		return path + "x";
+	}
+	return path + ".sd0x";
+}
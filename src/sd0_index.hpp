@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <istream>
+
+/**
+ *	Where one block of an sd0 file is, compressed and uncompressed
+ */
+struct sd0_index_entry
+{
+	uint64_t offset;	// The offset of the zlib stream in the file
+	uint32_t size;		// The compressed size
+	uint32_t length;	// The uncompressed size
+	uint64_t start;		// The offset of the block in the uncompressed data
+};
+
+/**
+ *	The fixed size start of an sd0 index file
+ */
+struct sd0_index_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t blockCount;
+	uint32_t reserved;
+	uint64_t fileSize;
+	int64_t fileMtime;
+};
+
+/*
+ * The block table of an sd0 file, for random access.
+ *
+ * Block headers only carry the compressed size, so building the table
+ * inflates every block once. The table can be written to a sidecar file
+ * (asset.sd0 -> asset.sd0x) that remembers the size and mtime of the file
+ * it was built from, so later readers only load it.
+ */
+class sd0_index {
+
+	std::vector<sd0_index_entry> blocks;
+	uint64_t total = 0;
+	uint64_t fileSize = 0;
+	int64_t fileMtime = 0;
+
+public:
+	// Builds the table from a stream positioned at the start of an sd0 file
+	bool build(std::istream& input);
+
+	// Builds the table for an sd0 file
+	bool build(const std::string& path);
+
+	// Reads a sidecar file, returns false if it is missing or invalid
+	bool open(const std::string& sidecar);
+
+	// Writes the table to a sidecar file
+	bool write(const std::string& sidecar) const;
+
+	// Whether the table was built from the current version of the file
+	bool fresh(const std::string& path) const;
+
+	// Reads the sidecar of a file if it is fresh, or builds the table and tries to write the sidecar
+	bool load(const std::string& path);
+
+	std::size_t size() const { return blocks.size(); }
+	const sd0_index_entry& at(std::size_t i) const { return blocks[i]; }
+	uint64_t uncompressed_size() const { return total; }
+
+	// The index of the block that contains an uncompressed offset, or -1
+	int32_t find(uint64_t position) const;
+
+	// The sidecar path for an sd0 file
+	static std::string sidecar_path(const std::string& path);
+};
@@ -1,222 +1,313 @@
 #pragma once
 
 #include <fstream>
-#include <cassert>
-#include <zlib.h>
 
 #include "stream.hpp"
+#include "sd0_codec.hpp"
+#include "sd0_writer.hpp"
+#include "sd0_index.hpp"
 
 /*
- * This class allows the reading of sd0 compressed files, as
- * by taking such a file and provides just the compressed part of it
- * as the buffer.
- *
+ * This class allows the reading of sd0 compressed files, as a stream
+ * of their uncompressed data. Each block is read whole, since its
+ * compressed length is known, and inflated in one go by the codec of
+ * an sd0_decoder; this class only moves the data between the streams
+ * and its buffers.
  */
-template<std::size_t SIZE>
 class sd0_istreambuf : public std::streambuf {
 
 	std::istream *input;
 
-	char ibuf[SIZE];			// The internal input buffer
-	char obuf[SIZE];			// The internal output buffer
-	int32_t block_remain = 0;	// How much bytes remain to be read in the current block
-	int32_t block_size = -1;	// How much bytes the current block has
+	std::vector<char> raw;		// The compressed current block
+	std::vector<char> obuf;		// The uncompressed current block
+	bool started = false;		// Whether the magic was read
+	bool failed = false;		// Whether the data turned out to be bad, nothing more is read then
 
-	int32_t block_decomp_size = 0;
+	sd0_decoder decoder;
 
-	bool fail;
-	bool open = false;
+	// Reads the next compressed block into raw, returns false at the end of the data
+	bool next_block() {
 
-	z_stream c_stream;			// The compression stream
-	int err;					// The error code
+		if (failed) return false;
 
-public:
-	sd0_istreambuf(std::istream *input) : input(input) {
+		if (!started) {
+			char magic[SD0_MAGIC_SIZE];
+			input->read(magic, SD0_MAGIC_SIZE);
 
-		block_remain = 0;
-		block_size = 0;
-		fail = false;
-		
-		char sm_buf[5];
-		char magic_buf[5] = {'s', 'd', '0', 1, -1};
-		
-		input->read(sm_buf, 5);
-		if (input->eof()) {
-			fail = true;
-			return;
+			if (!sd0_check_magic(magic, input->gcount())) {
+				std::cerr << "Invalid sd0 data, abort" << std::endl;
+				failed = true;
+				return false;
+			}
+			started = true;
 		}
 
-		for (int i = 0; i < 5; i++) {
-			if (sm_buf[i] != magic_buf[i]){
-				std::cout << "Header not found, abort" << std::endl;
-				return;
+		uint32_t length;
+		input->read((char*) &length, 4);
+		std::size_t got = input->gcount();
+		if (got == 0) return false;
+
+		if (got == 4) {
+			raw.resize(length);
+			input->read(raw.data(), length);
+			if ((std::size_t) input->gcount() == length) return true;
+		}
+
+		std::cerr << "Truncated sd0 data" << std::endl;
+		failed = true;
+		return false;
+	}
+
+	// Inflates the next block that is not empty, straight into dst if there is room for
+	// a whole block, or else into obuf; returns the bytes written to dst
+	std::size_t fill(char* dst, std::size_t length) {
+
+		obuf.clear();
+		setg(obuf.data(), obuf.data(), obuf.data());
+
+		while (next_block()) {
+
+			// A block that does not fit after all is inflated again into obuf
+			if (length >= SD0_BLOCK_SIZE) {
+				int64_t have = decoder.decode_block(raw.data(), raw.size(), dst, length);
+				if (have > 0) return have;
+				if (have == 0) continue;
 			}
+
+			if (!decoder.decode_block(raw.data(), raw.size(), obuf)) {
+				std::cerr << "Invalid sd0 data, abort" << std::endl;
+				failed = true;
+				obuf.clear();
+				return 0;
+			}
+
+			if (!obuf.empty()) break;
 		}
 
-		// Set functions that the stream may use
-		c_stream.zalloc = (alloc_func) 0;
-	    c_stream.zfree = (free_func) 0;
-	    c_stream.opaque = (voidpf) 0;
+		setg(obuf.data(), obuf.data(), obuf.data() + obuf.size());
+		return 0;
+	}
 
-	    // Set the initial pointers / values
-		c_stream.avail_in = SIZE;
-		c_stream.next_in = (Bytef*) &ibuf;
-		c_stream.avail_out = SIZE;
-		c_stream.next_out = (Bytef*) &obuf;
+public:
+	sd0_istreambuf(std::istream *input) : input(input) {
+		obuf.reserve(SD0_BLOCK_SIZE);
 
 		// Set the buffer as empty
-		setg((char*) &obuf, (char*) &obuf+SIZE, (char*) &obuf+SIZE);
-		
-	}
-
-	~sd0_istreambuf()
-	{
-		if (open) inflateEnd(&c_stream);
-	}
-
-	int_type underflow()
-	{
-		// When we have no more output to write
-		if (c_stream.avail_out != 0)
-		{	
-			// When the current block is empty
-			if (block_remain == 0)
-			{
-				// Check the next buffer size
-				input->read((char*) &block_size, 4);
-
-				// When the reading failed --> End of file
-				if (input->eof())
-				{
-					//std::cerr << block_decomp_size << std::endl;
-					//std::cerr << "EOF!" << std::endl;
-
-					// If not found -> end of file
-					return std::char_traits<char>::eof();
-				}
-
-				// Set the new block size
-				block_remain = block_size;
-				// std::cerr << "Size: " << block_size << "!" << std::endl;
-
-				// Close old streams
-				if (open)
-				{
-					//std::cerr << block_decomp_size << std::endl;
-					block_decomp_size = 0;
-					inflateEnd(&c_stream);
-				}
-
-				// Initialize the new stream
-				err = inflateInit(&c_stream);
-				open = true;
-			}
+		setg(obuf.data(), obuf.data(), obuf.data());
+	}
 
-			// Read the next amount of bytes
-			int32_t next = block_remain < SIZE ? block_remain : SIZE;
-			//std::cerr << "Try read " << next << " characters" << std::endl;
-			input->read(ibuf, next);
+	int_type underflow() {
 
-			int32_t len = input->eof() ? input->gcount() : next;
+		if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
 
-			// Set the input values
-			c_stream.avail_in = len;
-			c_stream.next_in = (Bytef*) &ibuf;
+		fill(nullptr, 0);
+		if (gptr() == egptr()) return traits_type::eof();
+		return traits_type::to_int_type(*gptr());
+	}
 
-			//std::cerr << "Read: " << len << " characters" << std::endl;
+	// Large reads are inflated straight into the caller's buffer
+	std::streamsize xsgetn(char* s, std::streamsize n) {
 
-			// Update remaining read space
-			block_remain -= len;
+		std::streamsize done = 0;
 
-		}
+		while (done < n) {
 
-		c_stream.avail_out = SIZE;
-		c_stream.next_out = (Bytef*) &obuf;
-
-		err = inflate(&c_stream, Z_NO_FLUSH);
-		int have = SIZE - c_stream.avail_out;
-
-		if (have > 0)
-		{	
-			block_decomp_size += have;			
-			setg((char*) &obuf, (char*) &obuf, (char*) &obuf + have);
-			int_type chr = std::char_traits<char>::to_int_type(*gptr());
-			
-			if (chr == std::char_traits<char>::eof())
-			{
-				std::cerr << "MISMATCH" << std::endl;
+			std::streamsize count = std::min<std::streamsize>(n - done, egptr() - gptr());
+			if (count > 0) {
+				memcpy(s + done, gptr(), count);
+				gbump(count);
+				done += count;
+				continue;
 			}
 
-			return chr;
+			std::size_t have = fill(s + done, n - done);
+			if (have == 0 && gptr() == egptr()) break;
+			done += have;
 		}
-		else return underflow();
+
+		return done;
 	}
 };
 
-template<std::size_t SIZE>
-std::istream* create_sd0_stream(std::istream* in)
+inline std::istream* create_sd0_stream(std::istream* in)
 {
-	return new closebuf_istream(new sd0_istreambuf<SIZE>(in));
+	return new closebuf_istream(new sd0_istreambuf(in));
 }
 
-template<std::size_t ISIZE, std::size_t OSIZE>
-class sd0_ostreambuf : public std::streambuf {
+/*
+ * This class reads sd0 compressed files with random access. It needs a
+ * seekable input and the block table of the file; seeking looks up the
+ * block that contains the target and inflates only that one.
+ */
+class sd0_seek_istreambuf : public std::streambuf {
+
+	std::istream* input;
+	const sd0_index* index;
+
+	sd0_decoder decoder;
+	std::vector<char> raw;		// The compressed current block
+	std::vector<char> block;	// The uncompressed current block
+	std::vector<char> scratch;	// The block being inflated, until it is known to be good
+	int32_t current = -1;		// The index of the current block
+	bool failed = false;		// Whether the last load failed, reading stops until a seek
+
+	// Forgets the current block after a failed load
+	bool fail() {
+		current = -1;
+		failed = true;
+		setg(nullptr, nullptr, nullptr);
+		return false;
+	}
+
+	// Inflates a block and makes it the get area
+	bool load(int32_t i) {
 
-	char ibuf[ISIZE];
-	char obuf[ISIZE];
+		if (i == current) return true;
 
-	std::ostream* output;
+		const sd0_index_entry& entry = index->at(i);
+		raw.resize(entry.size);
+		scratch.resize(entry.length);
+
+		input->clear();
+		input->seekg(entry.offset);
+		if (!input->read(raw.data(), entry.size)) return fail();
+		if (decoder.decode_block(raw.data(), entry.size, scratch.data(), scratch.size()) != entry.length) return fail();
+
+		block.swap(scratch);
+		current = i;
+		failed = false;
+		setg(block.data(), block.data(), block.data() + block.size());
+		return true;
+	}
+
+	// The uncompressed offset of the next character
+	uint64_t position() const {
+		return current < 0 ? 0 : index->at(current).start + (gptr() - eback());
+	}
 
 public:
-	sd0_ostreambuf(std::ostream* output) : output(output) {
+	sd0_seek_istreambuf(std::istream* input, const sd0_index* index) : input(input), index(index) {
+		setg(nullptr, nullptr, nullptr);
+	}
+
+	int_type underflow() {
 
-		char header[5] = {'s', 'd', '0', 1, -1};
-		output->write((char*) &header, 5);
-		setp((char*) &ibuf, (char*) &ibuf + ISIZE);
+		if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		if (failed) return traits_type::eof();
+
+		/* Skip over empty blocks */
+		for (int32_t next = current + 1; (std::size_t) next < index->size(); next++) {
+			if (!load(next)) return traits_type::eof();
+			if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		}
+
+		return traits_type::eof();
 	}
 
-	int_type overflow(int_type c) {
+	std::streamsize showmanyc() {
+		return index->uncompressed_size() - position();
+	}
 
-		z_stream c_stream;
-		c_stream.zalloc = (alloc_func) 0;
-	    c_stream.zfree = (free_func) 0;
-	    c_stream.opaque = (voidpf) 0;
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) {
 
-		deflateInit(&c_stream, 4);
+		off_type base = 0;
+		if (dir == std::ios_base::cur) base = position();
+		else if (dir == std::ios_base::end) base = index->uncompressed_size();
 
-		int32_t len = pptr() - (char*) &ibuf;
+		return seekpos(base + off, which);
+	}
 
-		c_stream.avail_in = len;
-		c_stream.next_in = (Bytef*) &ibuf;
-	
-		c_stream.avail_out = ISIZE;
-		c_stream.next_out = (Bytef*) &obuf;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) {
 
-		deflate(&c_stream, Z_FINISH);
+		off_type target = pos;
+		if (!(which & std::ios_base::in) || target < 0 || (uint64_t) target > index->uncompressed_size()) {
+			return pos_type(off_type(-1));
+		}
 
-		int32_t have = ISIZE - c_stream.avail_out;
-		if (have > 0) {
-			output->write((char*) &have, 4);
-			output->write((char*) &obuf, have);
+		/* The end of the data is the end of the last block */
+		int32_t i = index->find(target);
+		if (i == -1) {
+			if (index->size() == 0) return pos;
+			i = index->size() - 1;
 		}
 
-		assert(c_stream.avail_out > 0);
+		if (!load(i)) return pos_type(off_type(-1));
+		setg(eback(), eback() + (target - index->at(i).start), egptr());
+		return pos;
+	}
+};
+
+inline std::istream* create_sd0_seek_stream(std::istream* in, const sd0_index* index)
+{
+	return new closebuf_istream(new sd0_seek_istreambuf(in, index));
+}
+
+/*
+ * This class writes sd0 compressed files. The buffered bytes are passed
+ * on to an sd0_writer, which compresses whole blocks on a worker pool.
+ * sync only writes complete blocks, so that every block but the last has
+ * the standard size; the last one is written when the buffer is deleted.
+ */
+class sd0_ostreambuf : public std::streambuf {
 
-		deflateEnd(&c_stream);
-		ibuf[0] = c;
-		setp((char*) &ibuf + 1, (char*) &ibuf + ISIZE);
+	std::vector<char> buffer;	// The internal input buffer
+	sd0_writer writer;
 
-		return traits_type::to_int_type(c);
+	// Hands the buffered bytes to the writer
+	void drain() {
+		writer.write(pbase(), pptr() - pbase());
+		setp(buffer.data(), buffer.data() + buffer.size());
 	}
 
-	int_type sync() {
-		this->overflow(0);
-		this->output->flush();
+public:
+	sd0_ostreambuf(std::ostream* output, const sd0_options& options = sd0_options(), std::size_t size = stream_buffer_size())
+		: buffer(size), writer(output, options) {
+		setp(buffer.data(), buffer.data() + buffer.size());
+	}
+
+	~sd0_ostreambuf() {
+		drain();
+		writer.finish();
+	}
+
+	int_type overflow(int_type c) {
+
+		drain();
+
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+
+		return traits_type::not_eof(c);
+	}
+
+	// Large writes go to the writer without passing through the buffer
+	std::streamsize xsputn(const char* s, std::streamsize n) {
+
+		if (n < epptr() - pptr()) {
+			memcpy(pptr(), s, n);
+			pbump(n);
+			return n;
+		}
+
+		drain();
+		writer.write(s, n);
+		return n;
+	}
+
+	int sync() {
+		drain();
+		return writer.flush() ? 0 : -1;
 	}
 };
 
-template<std::size_t SIZE>
-std::ostream* create_sd0_ostream(std::ostream* in)
+inline std::ostream* create_sd0_ostream(std::ostream* in)
 {
-	return new closebuf_ostream(new sd0_ostreambuf<262144, SIZE>(in));
-}
\ No newline at end of file
+	return new closebuf_ostream(new sd0_ostreambuf(in));
+}
+
+inline std::ostream* create_sd0_ostream(std::ostream* in, const sd0_options& options)
+{
+	return new closebuf_ostream(new sd0_ostreambuf(in, options));
+}
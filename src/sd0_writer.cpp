@@ -0,0 +1,186 @@
+#include "sd0_writer.hpp"
+
+#include <algorithm>
+
+#include "parallel.hpp"
+
+sd0_writer::sd0_writer(std::ostream* output, const sd0_options& options) : output(output), options(options)
+{
+	if (this->options.threads == 0) this->options.threads = parallel::default_threads();
+	if (this->options.blockSize == 0) this->options.blockSize = SD0_BLOCK_SIZE;
+
+	output->write(SD0_MAGIC, SD0_MAGIC_SIZE);
+}
+
+sd0_writer::~sd0_writer()
+{
+	finish();
+}
+
+void sd0_writer::write(const char* data, std::size_t length)
+{
+	while (length > 0)
+	{
+		if (current == nullptr) current = take();
+
+		std::size_t count = std::min(options.blockSize - current->input.size(), length);
+		current->input.insert(current->input.end(), data, data + count);
+		data += count;
+		length -= count;
+
+		if (current->input.size() == options.blockSize) submit();
+	}
+}
+
+bool sd0_writer::flush()
+{
+	collect(true);
+	output->flush();
+	return !failed && output->good();
+}
+
+bool sd0_writer::finish()
+{
+	if (closed) return !failed && output->good();
+	closed = true;
+
+	if (current != nullptr && !current->input.empty()) submit();
+	collect(true);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+
+	output->flush();
+	return !failed && output->good();
+}
+
+/**
+ *	Returns an empty job, reusing the buffers of written ones
+ */
+sd0_writer::job* sd0_writer::take()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (spare.empty())
+	{
+		jobs.emplace_back(new job());
+		jobs.back()->input.reserve(options.blockSize);
+		return jobs.back().get();
+	}
+
+	job* j = spare.back();
+	spare.pop_back();
+	j->input.clear();
+	j->done = j->ok = false;
+	return j;
+}
+
+/**
+ *	Hands the current block to the workers, or compresses it right away
+ */
+void sd0_writer::submit()
+{
+	job* j = current;
+	current = nullptr;
+
+	if (options.threads <= 1)
+	{
+		if (!encoder) encoder.reset(new sd0_encoder(options.level));
+		j->ok = encoder->encode_block(j->input.data(), j->input.size(), j->output);
+		emit(j);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		spare.push_back(j);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (workers.empty())
+		{
+			for (unsigned t = 0; t < options.threads; t++)
+			{
+				workers.emplace_back(&sd0_writer::work, this);
+			}
+		}
+		todo.push_back(j);
+		pending.push_back(j);
+	}
+	ready.notify_one();
+
+	collect(false);
+}
+
+/**
+ *	Writes the compressed blocks at the front of the queue. Waits for all
+ *	of them, or only as long as too many blocks are in flight.
+ */
+void sd0_writer::collect(bool all)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!pending.empty())
+	{
+		job* j = pending.front();
+		if (!j->done)
+		{
+			if (!all && pending.size() <= 2 * (std::size_t) options.threads) break;
+			finished.wait(lock, [j] { return j->done; });
+		}
+		pending.pop_front();
+
+		lock.unlock();
+		emit(j);
+		lock.lock();
+
+		spare.push_back(j);
+	}
+}
+
+/**
+ *	Writes one compressed block with its length
+ */
+void sd0_writer::emit(job* j)
+{
+	if (!j->ok)
+	{
+		failed = true;
+		return;
+	}
+
+	uint32_t length = j->output.size();
+	output->write((const char*) &length, 4);
+	output->write(j->output.data(), length);
+}
+
+/**
+ *	The loop of a worker thread
+ */
+void sd0_writer::work()
+{
+	sd0_encoder encoder(options.level);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		ready.wait(lock, [this] { return stopping || !todo.empty(); });
+		if (todo.empty()) return;
+
+		job* j = todo.front();
+		todo.pop_front();
+
+		lock.unlock();
+		bool ok = encoder.encode_block(j->input.data(), j->input.size(), j->output);
+		lock.lock();
+
+		j->ok = ok;
+		j->done = true;
+		finished.notify_all();
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "sd0_codec.hpp"
+
+/**
+ *	How an sd0 file is written
+ */
+struct sd0_options
+{
+	int level = SD0_DEFAULT_LEVEL;
+	std::size_t blockSize = SD0_BLOCK_SIZE;
+	unsigned threads = 0;	// 0 for all cores
+};
+
+/*
+ * Writes an sd0 file, compressing the blocks on a worker pool.
+ *
+ * Data is collected into blocks of the configured size. Full blocks are
+ * handed to the workers, each of which keeps its own deflate state, and
+ * the compressed blocks are written in their original order. At most two
+ * blocks per worker are in flight, which bounds the memory use.
+ */
+class sd0_writer {
+
+	struct job
+	{
+		std::vector<char> input;
+		std::vector<char> output;
+		bool done = false;
+		bool ok = false;
+	};
+
+	std::ostream* output;
+	sd0_options options;
+
+	std::vector<std::unique_ptr<job>> jobs;	// Owns every job
+	std::vector<job*> spare;				// Jobs to reuse
+	std::deque<job*> todo;					// Jobs for the workers
+	std::deque<job*> pending;				// Jobs not yet written, in order
+	job* current = nullptr;					// The block being filled
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable ready;		// There are jobs or the workers should stop
+	std::condition_variable finished;	// A job was compressed
+	bool stopping = false;
+	bool failed = false;
+	bool closed = false;
+
+	std::unique_ptr<sd0_encoder> encoder;	// Used when there are no workers
+
+	job* take();
+	void submit();
+	void collect(bool all);
+	void emit(job* j);
+	void work();
+
+public:
+	sd0_writer(std::ostream* output, const sd0_options& options = sd0_options());
+	~sd0_writer();
+
+	sd0_writer(const sd0_writer&) = delete;
+	sd0_writer& operator=(const sd0_writer&) = delete;
+
+	// Adds data to the file
+	void write(const char* data, std::size_t length);
+
+	// Writes all complete blocks and flushes the output
+	bool flush();
+
+	// Writes the last block and stops the workers, returns false if anything failed
+	bool finish();
+};
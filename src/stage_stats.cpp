@@ -0,0 +1,206 @@
+#include "stage_stats.hpp"
+
+#include <iomanip>
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+void stage_link::add(uint64_t length, stage_clock::duration time)
+{
+	bytes += length;
+	calls++;
+	nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+uint64_t stage_report::self() const
+{
+	uint64_t blocked = upstream + downstream;
+	return wall > blocked ? wall - blocked : 0;
+}
+
+pipeline_stats::pipeline_stats() : start(stage_clock::now())
+{
+}
+
+stage_link* pipeline_stats::add(const std::string& name)
+{
+	stages.emplace_back();
+	stages.back().name = name;
+	return &stages.back().run;
+}
+
+stage_link* pipeline_stats::link(bool push)
+{
+	links.emplace_back(push);
+	return &links.back();
+}
+
+std::vector<stage_report> pipeline_stats::report() const
+{
+	std::vector<stage_report> result;
+
+	for (std::size_t i = 0; i < stages.size(); i++)
+	{
+		const stage_link* in = i > 0 && i - 1 < links.size() ? &links[i - 1] : nullptr;
+		const stage_link* out = i < links.size() ? &links[i] : nullptr;
+
+		stage_report r;
+		r.name = stages[i].name;
+
+		/* The ends of the pipeline pass their data on unchanged */
+		r.bytesIn = in ? in->bytes.load() : out ? out->bytes.load() : 0;
+		r.bytesOut = out ? out->bytes.load() : r.bytesIn;
+
+		if (in && !in->push) r.upstream = in->nanos;
+		if (out && out->push) r.downstream = out->nanos;
+
+		if (stages[i].run.calls > 0)
+		{
+			r.calls = stages[i].run.calls;
+			r.wall = stages[i].run.nanos;
+		}
+		else
+		{
+			if (out && !out->push) { r.calls += out->calls; r.wall += out->nanos; }
+			if (in && in->push) { r.calls += in->calls; r.wall += in->nanos; }
+		}
+
+		result.push_back(r);
+	}
+
+	return result;
+}
+
+void pipeline_stats::print_table(std::ostream& out) const
+{
+	double seconds = std::chrono::duration<double>(stage_clock::now() - start).count();
+
+	out << std::left << std::setw(24) << "Stage" << std::right
+	    << std::setw(11) << "In MiB" << std::setw(11) << "Out MiB" << std::setw(9) << "Calls"
+	    << std::setw(10) << "Wall ms" << std::setw(10) << "Up ms" << std::setw(10) << "Down ms"
+	    << std::setw(10) << "Self ms" << std::setw(10) << "MB/s" << std::endl;
+
+	out << std::fixed << std::setprecision(2);
+	for (const stage_report& r : report())
+	{
+		/* The throughput of the stage on its own, without its waits */
+		uint64_t self = r.self();
+		uint64_t bytes = std::max(r.bytesIn, r.bytesOut);
+
+		out << std::left << std::setw(24) << r.name.substr(0, 23) << std::right
+		    << std::setw(11) << r.bytesIn / 1048576.0 << std::setw(11) << r.bytesOut / 1048576.0
+		    << std::setw(9) << r.calls
+		    << std::setw(10) << r.wall / 1e6 << std::setw(10) << r.upstream / 1e6
+		    << std::setw(10) << r.downstream / 1e6 << std::setw(10) << self / 1e6;
+
+		if (self > 0) out << std::setw(10) << bytes * 1e3 / self;
+		else out << std::setw(10) << "-";
+		out << std::endl;
+	}
+
+	out << "Total: " << seconds << " s" << std::endl;
+	out << std::defaultfloat;
+}
+
+void pipeline_stats::print_json(std::ostream& out) const
+{
+	nlohmann::json doc;
+	doc["seconds"] = std::chrono::duration<double>(stage_clock::now() - start).count();
+	doc["stages"] = nlohmann::json::array();
+
+	for (const stage_report& r : report())
+	{
+		doc["stages"].push_back({
+			{"name", r.name},
+			{"bytesIn", r.bytesIn},
+			{"bytesOut", r.bytesOut},
+			{"calls", r.calls},
+			{"wallNs", r.wall},
+			{"upstreamNs", r.upstream},
+			{"downstreamNs", r.downstream},
+			{"selfNs", r.self()}
+		});
+	}
+
+	out << doc.dump(4) << std::endl;
+}
+
+metered_istreambuf::metered_istreambuf(std::istream* source, stage_link* link, std::size_t size)
+	: buffer(size), source(source), link(link)
+{
+	setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+metered_istreambuf::int_type metered_istreambuf::underflow()
+{
+	stage_clock::time_point start = stage_clock::now();
+	source->read(buffer.data(), buffer.size());
+	std::size_t length = source->gcount();
+	link->add(length, stage_clock::now() - start);
+
+	setg(buffer.data(), buffer.data(), buffer.data() + length);
+	if (length == 0) return traits_type::eof();
+	return traits_type::to_int_type(*gptr());
+}
+
+metered_istreambuf::pos_type metered_istreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+	/* The source is ahead by what is left in the buffer */
+	if (dir == std::ios_base::cur) off -= egptr() - gptr();
+	setg(buffer.data(), buffer.data(), buffer.data());
+
+	source->clear();
+	return source->rdbuf()->pubseekoff(off, dir, which);
+}
+
+metered_istreambuf::pos_type metered_istreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+	setg(buffer.data(), buffer.data(), buffer.data());
+
+	source->clear();
+	return source->rdbuf()->pubseekpos(pos, which);
+}
+
+metered_ostreambuf::metered_ostreambuf(std::ostream* sink, stage_link* link, std::size_t size)
+	: buffer(size), sink(sink), link(link)
+{
+	setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+metered_ostreambuf::~metered_ostreambuf()
+{
+	sync();
+}
+
+bool metered_ostreambuf::drain()
+{
+	std::size_t length = pptr() - pbase();
+	if (length == 0) return true;
+
+	stage_clock::time_point start = stage_clock::now();
+	sink->write(pbase(), length);
+	link->add(length, stage_clock::now() - start);
+
+	setp(buffer.data(), buffer.data() + buffer.size());
+	return sink->good();
+}
+
+metered_ostreambuf::int_type metered_ostreambuf::overflow(int_type c)
+{
+	if (!drain()) return traits_type::eof();
+	if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+int metered_ostreambuf::sync()
+{
+	if (!drain()) return -1;
+
+	stage_clock::time_point start = stage_clock::now();
+	sink->flush();
+	link->add(0, stage_clock::now() - start);
+	return sink->good() ? 0 : -1;
+}
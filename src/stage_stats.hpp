@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stream.hpp"
+
+typedef std::chrono::steady_clock stage_clock;
+
+/**
+ *	The data that passed between two neighbouring stages of a pipeline.
+ *	Input stages pull their data, so the time is spent by the upstream
+ *	stage while the downstream one waits for it. Output stages get their
+ *	data pushed, so the time is spent by the downstream stage while the
+ *	upstream one waits for it to return.
+ */
+struct stage_link
+{
+	bool push;
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> calls{0};
+	std::atomic<uint64_t> nanos{0};
+
+	stage_link(bool push) : push(push) {}
+
+	void add(uint64_t length, stage_clock::duration time);
+};
+
+/**
+ *	The totals of one stage. Wall time includes the time blocked on the
+ *	neighbours; stages that run on several threads add up their time.
+ */
+struct stage_report
+{
+	std::string name;
+	uint64_t bytesIn = 0;
+	uint64_t bytesOut = 0;
+	uint64_t calls = 0;
+	uint64_t wall = 0;			// Nanoseconds spent in the stage
+	uint64_t upstream = 0;		// Nanoseconds of that waiting for input
+	uint64_t downstream = 0;	// Nanoseconds of that waiting for output to be taken
+
+	// The time the stage spent on its own work
+	uint64_t self() const;
+};
+
+/*
+ * Collects the numbers of all stages of a pipeline.
+ *
+ * The stages are added in the order the data flows through them, with a
+ * link between each of them and the next. The meters on the links count
+ * the bytes and time on any thread, and the numbers of a stage are worked
+ * out from its two links at the end. Stages that are not driven through
+ * a stream, like transforms, time their runs themselves.
+ */
+class pipeline_stats {
+
+	struct stage
+	{
+		std::string name;
+		stage_link run{false};	// For stages that time themselves
+	};
+
+	std::deque<stage> stages;
+	std::deque<stage_link> links;	// links[i] goes from stages[i] to stages[i + 1]
+	stage_clock::time_point start;
+
+public:
+	pipeline_stats();
+
+	// Adds the next stage, returns the link for the stages that time themselves
+	stage_link* add(const std::string& name);
+
+	// The link from the last stage added to the next one
+	stage_link* link(bool push);
+
+	// The numbers of all stages, in the order of the data
+	std::vector<stage_report> report() const;
+
+	// Prints a table of all stages
+	void print_table(std::ostream& out) const;
+
+	// Writes all stages as a JSON document
+	void print_json(std::ostream& out) const;
+};
+
+/*
+ * Passes a stream through and counts what is read from it, and how long
+ * that takes, on a link.
+ */
+class metered_istreambuf : public std::streambuf {
+
+	std::vector<char> buffer;
+	std::istream* source;
+	stage_link* link;
+
+public:
+	metered_istreambuf(std::istream* source, stage_link* link, std::size_t size = stream_buffer_size());
+
+	int_type underflow();
+
+	// Seeks in the source, which is not counted
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in);
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in);
+};
+
+/*
+ * Passes the data written to it on to a sink, and counts it, and how long
+ * the sink takes for it, on a link.
+ */
+class metered_ostreambuf : public std::streambuf {
+
+	std::vector<char> buffer;
+	std::ostream* sink;
+	stage_link* link;
+
+	// Writes the buffer to the sink
+	bool drain();
+
+public:
+	metered_ostreambuf(std::ostream* sink, stage_link* link, std::size_t size = stream_buffer_size());
+
+	// Writes what is left
+	~metered_ostreambuf();
+
+	int_type overflow(int_type c);
+	int sync();
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "stream.hpp"
+#include "inflater.hpp"
+#include "mapped_file.hpp"
+#include "md5.h"
+
+/*
+ * Stages composed at compile time.
+ *
+ * A filter is a class template over the stage after it, which it holds
+ * by value, and a sink is the last stage. Both have
+ *
+ *   bool write(const char* data, std::size_t length);
+ *   bool finish();
+ *
+ * which return false on errors. A chain like sd0_filter<md5_sink> is one
+ * concrete type: the data is passed on as spans, without a streambuf or
+ * virtual call in between, and the compiler can inline the whole chain.
+ * The runtime InputStage chains of pipe stay for everything that is only
+ * known at run time.
+ */
+
+/**
+ *	Inflates sd0 data and passes the result on
+ */
+template<typename Next>
+class sd0_filter {
+
+	Next following;
+	sd0_inflater inflater;
+	std::vector<char> out;
+
+public:
+	template<typename... Args>
+	explicit sd0_filter(Args&&... args) : following(std::forward<Args>(args)...), out(stream_buffer_size()) {}
+
+	Next& next() { return following; }
+
+	bool write(const char* data, std::size_t length) {
+		while (true) {
+			char* dst = out.data();
+			std::size_t room = out.size();
+			if (inflater.inflate(data, length, dst, room) == INFLATE_ERROR) return false;
+
+			std::size_t produced = out.size() - room;
+			if (produced > 0 && !following.write(out.data(), produced)) return false;
+
+			// A full buffer may mean there is more, otherwise the input was used up
+			if (room > 0) return true;
+		}
+	}
+
+	bool finish() {
+		return inflater.at_boundary() && following.finish();
+	}
+};
+
+/**
+ *	Inflates a zlib stream and passes the result on, ignoring anything after its end
+ */
+template<typename Next>
+class zlib_filter {
+
+	Next following;
+	std::unique_ptr<codec> inflater;
+	std::vector<char> out;
+	bool ended = false;
+
+public:
+	template<typename... Args>
+	explicit zlib_filter(Args&&... args) : following(std::forward<Args>(args)...), inflater(create_codec("", -1)), out(stream_buffer_size()) {}
+
+	Next& next() { return following; }
+
+	bool write(const char* data, std::size_t length) {
+		while (!ended) {
+			char* dst = out.data();
+			std::size_t room = out.size();
+			inflate_status status = inflater->inflate_stream(data, length, dst, room);
+			if (status == INFLATE_ERROR) return false;
+			ended = status == INFLATE_END;
+
+			std::size_t produced = out.size() - room;
+			if (produced > 0 && !following.write(out.data(), produced)) return false;
+
+			if (room > 0 && !ended) return true;
+		}
+		return true;
+	}
+
+	bool finish() {
+		return ended && following.finish();
+	}
+};
+
+/**
+ *	Computes the MD5 and size of the data
+ */
+class md5_sink {
+
+	md5_state_t state;
+	md5_byte_t result[16];
+	uint64_t total = 0;
+
+public:
+	md5_sink() { md5_init(&state); }
+
+	bool write(const char* data, std::size_t length) {
+		md5_append(&state, (const md5_byte_t*) data, length);
+		total += length;
+		return true;
+	}
+
+	bool finish() {
+		md5_finish(&state, result);
+		return true;
+	}
+
+	// The digest, once finished
+	const md5_byte_t* digest() const { return result; }
+
+	uint64_t size() const { return total; }
+};
+
+/**
+ *	Writes the data to a stream
+ */
+class ostream_sink {
+
+	std::ostream* sink;
+
+public:
+	explicit ostream_sink(std::ostream* sink) : sink(sink) {}
+
+	bool write(const char* data, std::size_t length) {
+		sink->write(data, length);
+		return !sink->fail();
+	}
+
+	bool finish() {
+		sink->flush();
+		return !sink->fail();
+	}
+};
+
+/**
+ *	Feeds a stream through a chain in chunks, returns false on errors
+ */
+template<typename Chain>
+bool static_pump(std::istream* source, Chain& chain, std::size_t bufferSize = stream_buffer_size()) {
+	std::vector<char> buffer(bufferSize);
+	while (source->read(buffer.data(), buffer.size()) || source->gcount() > 0) {
+		if (!chain.write(buffer.data(), source->gcount())) return false;
+	}
+	return chain.finish();
+}
+
+/**
+ *	Feeds a whole file through a chain straight from a mapping, returns false on errors
+ */
+template<typename Chain>
+bool static_pump_file(const std::string& path, Chain& chain) {
+	mapped_file file;
+	if (!file.open(path)) return false;
+	if (file.size() > 0 && !chain.write(file.data(), file.size())) return false;
+	return chain.finish();
+}
@@ -1,6 +1,20 @@
 #pragma once
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#define STREAM_BUFFER_SIZE 65536
+
+// The buffer size of new stream buffers, which can be changed at run time
+inline std::size_t& stream_buffer_size()
+{
+	static std::size_t size = STREAM_BUFFER_SIZE;
+	return size;
+}
 
 template<typename T>
 class closebuf_basic_istream : public std::basic_istream<T> {
@@ -27,23 +41,23 @@ typedef closebuf_basic_ostream<char> closebuf_ostream;
 typedef closebuf_basic_ostream<wchar_t> closebuf_owstream;
 
 
-template<std::size_t SIZE>
+/*
+ * Passes the data of a stream through and writes a copy of it to a file.
+ */
 class dump_istreambuf : public std::streambuf {
 
-	char buffer[SIZE];
+	std::vector<char> buffer;
 	std::istream* wrapped;
 	std::ofstream* out;
 
 public:
-	dump_istreambuf(std::istream* wrapped, std::string file) : wrapped(wrapped) {
-
-		std::cerr << "ST" << std::endl;
+	dump_istreambuf(std::istream* wrapped, std::string file, std::size_t size = stream_buffer_size()) : buffer(size), wrapped(wrapped) {
 
 		// Create the output stream
 		out = new std::ofstream(file, std::ios::binary);
 
 		// Initialize empty buffer
-		setg((char*) &buffer, (char*) &buffer, (char*) &buffer);
+		setg(buffer.data(), buffer.data(), buffer.data());
 
 	}
 
@@ -54,19 +68,31 @@ public:
 
 	int_type underflow() {
 
-		wrapped->read(buffer, SIZE);
-		if (wrapped->eof()) {
+		wrapped->read(buffer.data(), buffer.size());
+		std::size_t len = wrapped->gcount();
+		out->write(buffer.data(), len);
+		setg(buffer.data(), buffer.data(), buffer.data() + len);
 
-			std::size_t len = wrapped->gcount();
-			out->write(buffer, len);
-			setg((char*) &buffer, (char*) &buffer, (char*) &buffer + len);
-			return std::char_traits<char>::eof();
-		}
-
-		out->write(buffer, SIZE);
-		setg((char*) &buffer, (char*) &buffer, (char*) &buffer + SIZE);
+		if (len == 0) return std::char_traits<char>::eof();
 		return std::char_traits<char>::to_int_type(*gptr());
 
 	}
 
+	// Large reads go straight into the caller's buffer
+	std::streamsize xsgetn(char* s, std::streamsize n) {
+
+		std::streamsize done = std::min<std::streamsize>(n, egptr() - gptr());
+		memcpy(s, gptr(), done);
+		gbump(done);
+
+		if (done < n) {
+			wrapped->read(s + done, n - done);
+			std::streamsize len = wrapped->gcount();
+			out->write(s + done, len);
+			done += len;
+		}
+
+		return done;
+	}
+
 };
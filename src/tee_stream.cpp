@@ -0,0 +1,117 @@
+#include "tee_stream.hpp"
+
+#include <algorithm>
+#include <limits>
+
+tee_broadcast::tee_broadcast(unsigned readers, unsigned depth, std::size_t chunkSize)
+	: ring(std::max(depth, 1u)), released(readers, 0)
+{
+	for (chunk& c : ring) c.data.resize(std::max<std::size_t>(chunkSize, 1));
+}
+
+uint64_t tee_broadcast::run(std::istream* source)
+{
+	uint64_t total = 0;
+
+	while (true)
+	{
+		chunk* target;
+		{
+			/* The slot is free once every reader still there is done with the chunk that was in it */
+			std::unique_lock<std::mutex> lock(mutex);
+			uint64_t slowest;
+			hasSpace.wait(lock, [this, &slowest]
+			{
+				slowest = *std::min_element(released.begin(), released.end());
+				return slowest == std::numeric_limits<uint64_t>::max() || produced - slowest < ring.size();
+			});
+
+			/* Nobody is left to read the rest */
+			if (slowest == std::numeric_limits<uint64_t>::max())
+			{
+				ended = true;
+				hasData.notify_all();
+				return total;
+			}
+			target = &ring[produced % ring.size()];
+		}
+
+		source->read(target->data.data(), target->data.size());
+		target->length = source->gcount();
+		target->offset = total;
+		total += target->length;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (target->length == 0) ended = true;
+		else produced++;
+		hasData.notify_all();
+
+		if (ended) return total;
+	}
+}
+
+const tee_broadcast::chunk* tee_broadcast::take(unsigned reader, uint64_t index)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (released[reader] < index)
+	{
+		released[reader] = index;
+		hasSpace.notify_one();
+	}
+
+	hasData.wait(lock, [this, index] { return produced > index || ended; });
+	if (produced <= index) return nullptr;
+	return &ring[index % ring.size()];
+}
+
+void tee_broadcast::leave(unsigned reader)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	released[reader] = std::numeric_limits<uint64_t>::max();
+	hasSpace.notify_one();
+}
+
+tee_istreambuf::int_type tee_istreambuf::underflow()
+{
+	if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+	const tee_broadcast::chunk* next = broadcast->take(reader, index);
+	if (next == nullptr)
+	{
+		offset += egptr() - eback();
+		setg(nullptr, nullptr, nullptr);
+		return traits_type::eof();
+	}
+
+	index++;
+	offset = next->offset;
+
+	char* data = const_cast<char*>(next->data.data());
+	setg(data, data, data + next->length);
+	return traits_type::to_int_type(*gptr());
+}
+
+tee_istreambuf::pos_type tee_istreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode)
+{
+	uint64_t position = offset + (gptr() - eback());
+	if (dir == std::ios_base::beg) off -= position;
+	else if (dir != std::ios_base::cur) return pos_type(off_type(-1));
+
+	/* The data before the current chunk is gone */
+	if (off < 0 && -off > gptr() - eback()) return pos_type(off_type(-1));
+
+	while (off > egptr() - gptr())
+	{
+		off -= egptr() - gptr();
+		setg(eback(), egptr(), egptr());
+		if (traits_type::eq_int_type(underflow(), traits_type::eof())) return pos_type(offset);
+	}
+
+	setg(eback(), gptr() + off, egptr());
+	return pos_type(offset + (gptr() - eback()));
+}
+
+tee_istreambuf::pos_type tee_istreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
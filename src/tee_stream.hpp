@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#define TEE_DEPTH 8
+#define TEE_CHUNK_SIZE 262144
+
+/*
+ * Hands the data of one stream to several readers without copying it.
+ *
+ * The producer reads the source into a ring of chunks, and every reader
+ * gets a tee_istreambuf that reads the chunks in place. A chunk is only
+ * refilled once all readers are past it, so the slowest reader sets the
+ * pace. A reader that stops early has to say so with leave(), so that it
+ * does not hold up the others.
+ */
+class tee_broadcast {
+
+	struct chunk
+	{
+		std::vector<char> data;
+		std::size_t length = 0;
+		uint64_t offset = 0;	// The position of the chunk in the stream
+	};
+
+	std::vector<chunk> ring;
+	std::vector<uint64_t> released;	// The number of chunks each reader is done with
+	uint64_t produced = 0;
+	bool ended = false;
+
+	std::mutex mutex;
+	std::condition_variable hasData;
+	std::condition_variable hasSpace;
+
+	friend class tee_istreambuf;
+
+	// Waits for chunk `index` after releasing the ones before it, returns null at the end
+	const chunk* take(unsigned reader, uint64_t index);
+
+public:
+	tee_broadcast(unsigned readers, unsigned depth = TEE_DEPTH, std::size_t chunkSize = TEE_CHUNK_SIZE);
+
+	// Reads the source into the readers until it ends or all of them left, returns the number of bytes
+	uint64_t run(std::istream* source);
+
+	// Lets go of all chunks for a reader that is finished
+	void leave(unsigned reader);
+};
+
+/*
+ * One reader of a tee_broadcast. Relative seeks forward skip data, which
+ * is all that stages reading a one-way stream need.
+ */
+class tee_istreambuf : public std::streambuf {
+
+	tee_broadcast* broadcast;
+	unsigned reader;
+	uint64_t index = 0;			// The chunk after the one being read
+	uint64_t offset = 0;		// The position of the chunk being read
+
+public:
+	tee_istreambuf(tee_broadcast* broadcast, unsigned reader) : broadcast(broadcast), reader(reader) {
+		setg(nullptr, nullptr, nullptr);
+	}
+
+	int_type underflow();
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+};
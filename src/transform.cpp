@@ -7,12 +7,13 @@
 #include <cmath>
 #include <cstring>
 #include <algorithm>
+#include <thread>
 
 #include <assembly/catalog.hpp>
 #include <assembly/manifest.hpp>
-#include <assembly/filesystem.hpp>
 
-#include "sd0_stream.hpp"
+#include "tee_stream.hpp"
+#include "cache_extract.hpp"
 #include "md5.h"
 
 extern int verbose_flag;
@@ -22,6 +23,10 @@ extern int verbose_flag;
 using namespace assembly::manifest;
 using namespace assembly::catalog;
 
+std::string ConfigTransformStage::name() const {
+    return "Config";
+}
+
 void ConfigTransformStage::run(std::istream* source, std::ostream* sink) {
     //gfxDataStore store;
 
@@ -36,6 +41,10 @@ void ConfigTransformStage::run(std::istream* source, std::ostream* sink) {
     }
 }
 
+std::string NoTransformStage::name() const {
+    return "Copy";
+}
+
 void NoTransformStage::run(std::istream* source, std::ostream* sink) {
 
     char buf[512];
@@ -46,6 +55,10 @@ void NoTransformStage::run(std::istream* source, std::ostream* sink) {
 
 }
 
+std::string MD5TransformStage::name() const {
+    return "MD5";
+}
+
 void MD5TransformStage::run(std::istream* source, std::ostream* sink) {
 
     uint SIZE = 2048;
@@ -74,11 +87,65 @@ void MD5TransformStage::run(std::istream* source, std::ostream* sink) {
     *sink << std::dec << " - " << size << " Bytes" << std::endl;
 }
 
+TeeTransformStage::TeeTransformStage(std::vector<TransformStage*> branches) : branches(branches)
+{
+
+}
+
+std::string TeeTransformStage::name() const
+{
+    std::string result = "Tee(";
+    for (std::size_t i = 0; i < branches.size(); i++)
+    {
+        if (i > 0) result += ", ";
+        result += branches[i]->name();
+    }
+    return result + ")";
+}
+
+void TeeTransformStage::run(std::istream* source, std::ostream* sink)
+{
+    /* Every branch reads the same chunks on its own thread */
+    tee_broadcast broadcast(branches.size());
+    std::vector<std::ostringstream> reports(branches.size());
+    std::vector<std::thread> threads;
+
+    for (std::size_t i = 0; i < branches.size(); i++)
+    {
+        threads.emplace_back([this, i, sink, &broadcast, &reports]
+        {
+            tee_istreambuf buf(&broadcast, i);
+            std::istream in(&buf);
+            branches[i]->run(&in, i == 0 ? sink : &reports[i]);
+            broadcast.leave(i);
+        });
+    }
+
+    broadcast.run(source);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    /* The sink carries the data of the first branch, so the reports must not end up in it */
+    std::ostream& report = report_stream();
+    for (std::size_t i = 1; i < branches.size(); i++)
+    {
+        report << reports[i].str();
+    }
+    report.flush();
+}
+
 ManifestTransformStage::ManifestTransformStage(std::string base_url) : base_url(base_url)
 {
 
 }
 
+std::string ManifestTransformStage::name() const {
+    return "Manifest";
+}
+
 void ManifestTransformStage::run(std::istream* source, std::ostream* sink)
 {
     manifest_file manifest;
@@ -106,6 +173,10 @@ void ManifestTransformStage::run(std::istream* source, std::ostream* sink)
     }
 }
 
+std::string PackIndexTransformStage::name() const {
+    return "PackIndex";
+}
+
 void PackIndexTransformStage::run(std::istream* source, std::ostream* sink) {
 
     catalog_file file;
@@ -160,6 +231,10 @@ void PackIndexTransformStage::run(std::istream* source, std::ostream* sink) {
     }
 }
 
+std::string SD0TransformStage::name() const {
+    return "Check SD0";
+}
+
 void SD0TransformStage::run(std::istream* source, std::ostream* sink) {
 
     char header[6] = {0,0,0,0,0,0};
@@ -195,34 +270,27 @@ void SD0TransformStage::run(std::istream* source, std::ostream* sink) {
 
 ClientExtractorStage::ClientExtractorStage(std::string folder) : folder(folder) {}
 
+std::string ClientExtractorStage::name() const {
+    return "ClientExtract";
+}
+
 void ClientExtractorStage::run(std::istream* source, std::ostream* sink) {
 
     manifest_file manifest;
     read_from_stream(*source, manifest);
 
-    NoTransformStage worker;
-
-    for (manifest_entry& entry : manifest.files) {
+    cache_extractor extractor(this->folder);
+    extractor.verbose = verbose_flag;
+    cache_stats stats = extractor.run(manifest.files, threads);
 
-        std::string srcpath = this->folder + entry.checkA + ".sd0";
-        std::ifstream infile(srcpath);
-        if (!infile.is_open())
-        {
-            std::cerr << "File " << std::setw(35) << srcpath;
-            std::cerr << " (" << entry.path << ") not found!" << std::endl;
-        }
-        else
-        {
-            std::ofstream outfile(entry.path);
-            fs::ensure_dir_exists(entry.path);
-
-            sd0_istreambuf<1024> inflate_buf(&infile);
-            std::istream inflated(&inflate_buf);
-
-            worker.run(&inflated, &outfile);
+    for (const cache_failure& failure : extractor.failures()) {
+        std::cerr << "File " << std::setw(35) << failure.object;
+        if (failure.missing) std::cerr << " (" << failure.path << ") not found!" << std::endl;
+        else std::cerr << " (" << failure.path << "): " << failure.reason << std::endl;
+    }
 
-            infile.close();
-            outfile.close();
-        }
-     }
+    if (verbose_flag || !extractor.failures().empty()) {
+        std::cerr << "Extracted " << stats.files << " files (" << (stats.bytesOut >> 20) << " MiB) in "
+                  << stats.seconds << " s, " << stats.missing << " missing, " << stats.failed << " failed" << std::endl;
+    }
 }
@@ -6,11 +6,22 @@
 class ConfigTransformStage : public TransformStage {
 public:
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class NoTransformStage : public TransformStage {
 public:
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
+};
+
+class TeeTransformStage : public TransformStage {
+    std::vector<TransformStage*> branches;
+public:
+    // The first branch writes to the sink, the output of the others goes to the report stream
+    TeeTransformStage(std::vector<TransformStage*> branches);
+    void run(std::istream* source, std::ostream* sink);
+    std::string name() const;
 };
 
 class ManifestTransformStage : public TransformStage {
@@ -18,21 +29,25 @@ class ManifestTransformStage : public TransformStage {
 public:
 	ManifestTransformStage(std::string base_url);
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class PackIndexTransformStage : public TransformStage {
 public:
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class MD5TransformStage : public TransformStage {
 public:
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class SD0TransformStage : public TransformStage {
 public:
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
 
 class ClientExtractorStage : public TransformStage
@@ -42,9 +57,13 @@ protected:
 	std::string folder;
 
 public:
+	// The number of files extracted at once (0 for all cores)
+	unsigned threads = 0;
+
 	// Constructor, providing the source folder
 	ClientExtractorStage(std::string folder);
 
 	// The running method
 	void run(std::istream* source, std::ostream* sink);
+	std::string name() const;
 };
@@ -1,22 +1,48 @@
 #pragma once
 
 #include <fstream>
-#include <zlib.h>
 #include "stream.hpp"
+#include "codec.hpp"
 
 /* This class provides an input stream buffer that
  * allows on-the-fly decompression of zlib streams
- * within the input stream pipeline.
+ * within the input stream pipeline. The decoding itself
+ * is done by the inflate_stream of a codec on the buffers
+ * of this class.
  */
-template<std::size_t SIZE>
 class zlib_istreambuf: public std::streambuf {
 	
-	std::istream *input;	// The input stream to read from
-	char ibuf[SIZE];		// The internal input buffer
-	char obuf[SIZE];		// The internal output buffer
-	
-	z_stream c_stream;		// The stream for decompression
-	int err;				// The error state
+	std::istream *input;		// The input stream to read from
+	std::vector<char> ibuf;		// The internal input buffer
+	std::vector<char> obuf;		// The internal output buffer
+	const char* next;			// The first unused byte in ibuf
+	std::size_t avail = 0;		// The number of unused bytes in ibuf
+
+	std::unique_ptr<codec> inflater;	// The decompression state
+
+	// Inflates into dst until something was written or the data ended
+	std::size_t fill(char* dst, std::size_t length) {
+
+		while (true) {
+
+			// Fill the buffer when all input was used
+			if (avail == 0) {
+				input->read(ibuf.data(), ibuf.size());
+				avail = input->gcount();
+				next = ibuf.data();
+			}
+
+			bool last = avail == 0;
+			char* out = dst;
+			std::size_t space = length;
+
+			inflate_status status = inflater->inflate_stream(next, avail, out, space);
+			std::size_t have = length - space;
+
+			// When nothing more will be written
+			if (have > 0 || status != INFLATE_OK || last) return have;
+		}
+	}
 
 public:
 
@@ -25,87 +51,40 @@ public:
 	using int_type = Base::int_type;
 
 	// Constructor for this stream buffer
-	zlib_istreambuf(std::istream *input) : input(input) {
-		
-		// Set functions that the stream may use
-		c_stream.zalloc = (alloc_func) 0;
-	    c_stream.zfree = (free_func) 0;
-	    c_stream.opaque = (voidpf) 0;
-
-	    // Initialize z_stream pointers
-	    c_stream.avail_in = 0;
-	    c_stream.avail_out = SIZE;
-
-	    // Initialize the inflating
-	    err = inflateInit(&c_stream);
-	    
-	    // Set badbit when stream is not ok
-	    if (err != Z_OK) {
-	    	
-	    	// setstate(std::ios_base::badbit);
-	    	return;
-	    }
+	zlib_istreambuf(std::istream *input, std::size_t size = stream_buffer_size()) : input(input), ibuf(size), obuf(size), inflater(create_codec("", -1)) {
+		next = ibuf.data();
 
 	    // Set the input buffer as full
-	    setg((char*) &obuf,(char*) &obuf+SIZE,(char*) &obuf+SIZE);
-	}
-
-	~zlib_istreambuf(){
-		inflateEnd(&c_stream);
+	    setg(obuf.data(), obuf.data() + size, obuf.data() + size);
 	}
 
 	// The underflow function for refilling the buffer
 	int_type underflow() {
 
-		// Check whether we have no more data to inflate
-		if (c_stream.avail_out != 0) {
+		std::size_t have = fill(obuf.data(), obuf.size());
+		setg(obuf.data(), obuf.data(), obuf.data() + have);
 
-			// Fill the buffer
-			input->read(ibuf, SIZE);
-			int_type len = input->eof() ? input->gcount() : SIZE;
-
-			// When nothing was read, end of file
-			if (len == 0) {
-
-				// Clean up the stream
-				inflateEnd(&c_stream);
-				return std::char_traits<char>::eof();
-			}
-			
-			// Set the input for the zlib stream
-			c_stream.avail_in = len;
-			c_stream.next_in = (unsigned char*) &ibuf;
-		}
-
-		// Set the outbut buffer for the zlib stream
-		c_stream.avail_out = SIZE;
-		c_stream.next_out = (unsigned char*) &obuf;
-
-		// Inflate and update streambuf pointers
-		err = inflate(&c_stream, Z_FINISH);
-		int have = SIZE - c_stream.avail_out;
-
-		// Set the new pointers
-		setg((char*) &obuf, (char*) &obuf, (char*) &obuf+have);
-
-		if (have == 0) return underflow();
+		if (have == 0) return std::char_traits<char>::eof();
+		return std::char_traits<char>::to_int_type(*gptr());
+	}
 
-		// When nothing has been written
-		/*if (c_stream.avail_out == SIZE) {
+	// Large reads are inflated straight into the caller's buffer
+	std::streamsize xsgetn(char* s, std::streamsize n) {
 
-			std::cerr << "This CASE " << have << std::endl;
+		std::streamsize done = std::min<std::streamsize>(n, egptr() - gptr());
+		memcpy(s, gptr(), done);
+		gbump(done);
 
-			// Clean up the stream
-			inflateEnd(&c_stream);
-			return std::char_traits<char>::eof();
-		}*/
+		while (done < n) {
+			std::size_t have = fill(s + done, n - done);
+			if (have == 0) break;
+			done += have;
+		}
 
-		// Return the next available character
-		return std::char_traits<char>::to_int_type(*gptr());
+		return done;
 	}
 };
 
-template<std::size_t SIZE>
-std::istream* create_inflate_stream(std::istream* in) {
-	return new closebuf_istream(new zlib_istreambuf<SIZE>(in));
+inline std::istream* create_inflate_stream(std::istream* in) {
+	return new closebuf_istream(new zlib_istreambuf(in));
 }